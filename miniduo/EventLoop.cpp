@@ -2,14 +2,22 @@
 #include "logging.h"
 #include "channel.h"
 #include "poller.h"
+#include "buffer.h" // Buffer::kInitialSize
 
 
+#include <algorithm>
 #include <cassert>
 #include <poll.h> 
 #include <iostream>
 #include <unistd.h>
+#include <chrono>
+#include <errno.h>
+#include <pthread.h> // pthread_setaffinity_np()
 #include <sys/eventfd.h> // ::eventfd()
 
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::NET
+
 namespace  miniduo
 {
 
@@ -52,10 +60,26 @@ using namespace miniduo;
 EventLoop::EventLoop()
     : stoplooping_(true),
       tid_(-1),
-      poller_(new EPollPoller(this)),     
+      poller_(BasePoller::newDefaultPoller(this)),     
       wakeupFd_(createEventfd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
-      timerQueue_(new TimerQueue(this))
+      timerQueue_(new TimerQueue(this)),
+      wakeupPending_(false),
+      tasksRun_(0),
+      wakeups_(0),
+      maxBatch_(0),
+      spinBudgetUs_(0),
+      cpuAffinity_(-1),
+      spinNs_(0),
+      sleepNs_(0),
+      spinHits_(0),
+      sleeps_(0),
+      connectionLoad_(0),
+      pendingBytes_(0),
+      bufferBytes_(0),
+      bufferSizeHint_(Buffer::kInitialSize),
+      pollReturnTime_(util::getTimeOfNow()),
+      monotonicTime_(util::getMonotonicNow())
 {   
     // 检查当前 thread 是否已存在 EventLoop
     // log trace EventLoop created
@@ -93,18 +117,20 @@ void EventLoop::loop(){
     settid(util::currentTid());
     stoplooping_ = false;
     assertInLoopThread();
+    bindCpu();
     log_trace("EventLoop %p Looping starts!", this);
     while(!stoplooping_) {
         doPendingTasks();
         activeChannels_.clear();
-        Timestamp recvTime = poller_->poll(kPollTimeMs, &activeChannels_);
+        Timestamp recvTime = pollEvents();
+        pollReturnTime_ = recvTime;
         for(ChannelList::iterator it = activeChannels_.begin();
             it != activeChannels_.end();
             ++it)
         {
             (*it)->handleEvent(recvTime);
         }
-        
+        poller_->dispatchCompletions(recvTime);
     }
     settid(-1);
 
@@ -113,6 +139,88 @@ void EventLoop::loop(){
     log_trace("EventLoop %p stop looping", this);
 }
 
+namespace {
+inline uint64_t nsSince(std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+inline Timestamp toMicroseconds(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+inline void addRelaxed(std::atomic<uint64_t>& counter, uint64_t n) {
+    // 只有 loop 线程写
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+} // namespace
+
+Timestamp EventLoop::pollEvents() {
+    if(spinBudgetUs_ <= 0) {
+        return pollBlocking();
+    }
+    // 自旋期间 loop 是醒着的，生产者不必写 eventfd
+    wakeupPending_.store(true);
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + std::chrono::microseconds(spinBudgetUs_);
+    while(true) {
+        Timestamp recvTime = poller_->poll(0, &activeChannels_);
+        const auto now = std::chrono::steady_clock::now();
+        monotonicTime_ = toMicroseconds(now);
+        if(!activeChannels_.empty() || poller_->hasPendingCompletions()
+           || !pendingTasks_.empty() || stoplooping_) {
+            addRelaxed(spinNs_, nsSince(start, now));
+            addRelaxed(spinHits_, 1);
+            return recvTime;
+        }
+        if(now >= deadline) {
+            addRelaxed(spinNs_, nsSince(start, now));
+            break;
+        }
+    }
+    // 恢复唤醒: exchange 与生产者的 exchange 同步，
+    // 此前看到 wakeupPending_ 为 true 而未写 eventfd 的任务此时一定可见
+    wakeupPending_.exchange(false);
+    if(!pendingTasks_.empty()) {
+        return util::getTimeOfNow();
+    }
+    return pollBlocking();
+}
+
+Timestamp EventLoop::pollBlocking() {
+    const auto start = std::chrono::steady_clock::now();
+    Timestamp recvTime = poller_->poll(kPollTimeMs, &activeChannels_);
+    const auto now = std::chrono::steady_clock::now();
+    monotonicTime_ = toMicroseconds(now);
+    addRelaxed(sleepNs_, nsSince(start, now));
+    addRelaxed(sleeps_, 1);
+    return recvTime;
+}
+
+void EventLoop::bindCpu() {
+    if(cpuAffinity_ < 0) {
+        return;
+    }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpuAffinity_, &cpuset);
+    int ret = ::pthread_setaffinity_np(::pthread_self(), sizeof cpuset, &cpuset);
+    if(ret != 0) {
+        errno = ret;
+        log_error("EventLoop %p failed to bind cpu %d", this, cpuAffinity_);
+    }
+    else {
+        log_trace("EventLoop %p bound to cpu %d", this, cpuAffinity_);
+    }
+}
+
+EventLoop::SpinStats EventLoop::spinStats() const {
+    SpinStats stats;
+    stats.spinNs = spinNs_.load(std::memory_order_relaxed);
+    stats.sleepNs = sleepNs_.load(std::memory_order_relaxed);
+    stats.spinHits = spinHits_.load(std::memory_order_relaxed);
+    stats.sleeps = sleeps_.load(std::memory_order_relaxed);
+    return stats;
+}
+
 void EventLoop::abortNotInLoopThread(){
     log_fatal("Abort! not in Loop Thread");
     // pthread_exit(nullptr);
@@ -155,53 +263,79 @@ TimerId EventLoop::runAt(const Timestamp time, const TimerCallback &cb) {
 }
 
 TimerId EventLoop::runAfter(double delay, const TimerCallback &cb) {
-    Timestamp time = util::getTimeOfNow() + (Timestamp) (delay * 1000000);
+    Timestamp time = cachedOrCurrentTime() + (Timestamp) (delay * 1000000);
     return runAt(time, cb);
 }
 
 TimerId EventLoop::runEvery(double interval, const TimerCallback &cb) {
-    Timestamp time = util::getTimeOfNow() + (Timestamp) (interval * 1000000);
+    Timestamp time = cachedOrCurrentTime() + (Timestamp) (interval * 1000000);
     auto timer = std::make_shared<Timer> (cb, time, interval);
     TimerId id = timer;
     runInLoop(std::bind(&TimerQueue::addTimer, timerQueue_.get(), std::move(timer)));
     return id;
 }
 
+Timestamp EventLoop::cachedOrCurrentTime() {
+    return isInLoopThread() ? pollReturnTime_ : util::getTimeOfNow();
+}
+
 void EventLoop::cancel(TimerId timerId) {
     runInLoop(std::bind(&TimerQueue::cancelTimer, timerQueue_.get(), timerId));
 }
 
-void EventLoop::runInLoop(const Task& cb) {
+void EventLoop::addWheelTimer(WheelTimer* timer, double delay) {
+    timerQueue_->addWheelTimer(timer, delay);
+}
+
+void EventLoop::runInLoop(Task&& cb) {
     if(isInLoopThread()) {
         cb();
     }
     else {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
     
 }
 
-void EventLoop::queueInLoop(const Task& cb) {
-    
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        pendingTasks_.push_back(cb);
+void EventLoop::queueInLoop(Task&& cb) {
+    pendingTasks_.push(std::move(cb));
+    // 只有 loop 处理完任务后的第一次入队需要写 eventfd
+    if(!wakeupPending_.exchange(true)) {
+        wakeup();
     }
-    wakeup();
 }
 
 void EventLoop::doPendingTasks() {
-    std::vector<Task> tasks;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        tasks.swap(pendingTasks_);
+    // 先清除标记再取任务: 之后入队的任务一定会再次写 eventfd
+    wakeupPending_.exchange(false);
+    // 只执行本次取出的任务，执行过程中新入队的任务留到下一轮 loop
+    Task task;
+    while(pendingTasks_.pop(task)) {
+        runningTasks_.push_back(std::move(task));
+    }
+    const uint64_t batch = runningTasks_.size();
+    for(const Task& t: runningTasks_) {
+        t();
     }
-    for(const Task& task: tasks) {
-        task();
+    runningTasks_.clear();
+    tasksRun_.store(tasksRun_.load(std::memory_order_relaxed) + batch,
+                    std::memory_order_relaxed);
+    if(batch > maxBatch_.load(std::memory_order_relaxed)) {
+        maxBatch_.store(batch, std::memory_order_relaxed);
     }
 }
 
+EventLoop::TaskQueueStats EventLoop::taskQueueStats() const {
+    TaskQueueStats stats;
+    stats.tasksRun = tasksRun_.load(std::memory_order_relaxed);
+    stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+    stats.coalescedWakeups = stats.tasksRun > stats.wakeups ? stats.tasksRun - stats.wakeups : 0;
+    stats.maxBatch = maxBatch_.load(std::memory_order_relaxed);
+    return stats;
+}
+
 void EventLoop::wakeup() {
+    wakeups_.fetch_add(1, std::memory_order_relaxed);
     uint64_t one = 1;
     ssize_t n = ::write(wakeupFd_, &one, sizeof one);
     if(n != sizeof one) {
@@ -219,14 +353,32 @@ void EventLoop::handleRead(Timestamp recvTime) {
 
 }
 
+IoUringPoller* EventLoop::ioUringPoller() {
+    return dynamic_cast<IoUringPoller*>(poller_.get());
+}
+
 EventLoop* EventLoop::allocLoop() {
     return this;
 }
 
+void EventLoop::observeBufferPeak(size_t peak) {
+    const size_t kMinHint = 256;
+    const size_t kMaxHint = 65536; // 与 readFd 的 extrabuf 一致，更大的消息仍按需扩展
+    peak = std::min(std::max(peak, kMinHint), kMaxHint);
+    // 指数平滑，权重 1/8
+    size_t hint = bufferSizeHint_.load(std::memory_order_relaxed);
+    bufferSizeHint_.store(hint - hint / 8 + peak / 8, std::memory_order_relaxed);
+}
+
+std::vector<EventLoop*> EventLoop::ioLoops() {
+    return std::vector<EventLoop*>(1, this);
+}
+
 EventLoops::EventLoops(int loopNum)
-    : size_(loopNum),
+    : subLoops_(loopNum),
+      size_(loopNum),
       next_(0),
-      subLoops_(loopNum)   
+      policy_(PlacementPolicy::kRoundRobin)
 {
 
 }
@@ -239,10 +391,84 @@ EventLoop* EventLoops::allocLoop() {
     if(size_ == 0) {
         return this;
     }
-    EventLoop* loop = &subLoops_[next_];
-    assert(loop != nullptr);
-    next_ = (next_ + 1) % size_;
-    return loop;
+    int index = 0;
+    switch(policy_) {
+    case PlacementPolicy::kLeastConnections:
+        index = leastLoaded(false);
+        break;
+    case PlacementPolicy::kLeastPendingBytes:
+        index = leastLoaded(true);
+        break;
+    case PlacementPolicy::kPowerOfTwoChoices:
+        index = powerOfTwoChoices();
+        break;
+    default:
+        index = next_.fetch_add(1, std::memory_order_relaxed) % size_;
+        break;
+    }
+    return &subLoops_[index];
+}
+
+int EventLoops::leastLoaded(bool byPendingBytes) {
+    // 负载相同时从轮转位置开始比较，避免总是选中第一个
+    const int start = next_.fetch_add(1, std::memory_order_relaxed) % size_;
+    int best = start;
+    for(int i=1; i<size_; i++) {
+        const int index = (start + i) % size_;
+        const EventLoop& loop = subLoops_[index];
+        const EventLoop& bestLoop = subLoops_[best];
+        bool better = loop.connectionLoad() < bestLoop.connectionLoad();
+        if(byPendingBytes) {
+            better = loop.pendingBytes() < bestLoop.pendingBytes()
+                  || (loop.pendingBytes() == bestLoop.pendingBytes() && better);
+        }
+        if(better) {
+            best = index;
+        }
+    }
+    return best;
+}
+
+int EventLoops::powerOfTwoChoices() {
+    thread_local uint32_t seed = static_cast<uint32_t>(util::currentTid()) * 2654435761u | 1;
+    // xorshift32
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    const int first = seed % size_;
+    if(size_ == 1) {
+        return first;
+    }
+    const int second = (first + 1 + (seed >> 16) % (size_ - 1)) % size_;
+    return subLoops_[second].connectionLoad() < subLoops_[first].connectionLoad()
+         ? second : first;
+}
+
+void EventLoops::setSpinBudget(int usec) {
+    EventLoop::setSpinBudget(usec);
+    for(auto &loop: subLoops_) {
+        loop.setSpinBudget(usec);
+    }
+}
+
+void EventLoops::setCpuAffinity(const std::vector<int>& cpus) {
+    if(!cpus.empty()) {
+        EventLoop::setCpuAffinity(cpus[0]);
+    }
+    for(int i=0; i<size_ && i+1<static_cast<int>(cpus.size()); i++) {
+        subLoops_[i].setCpuAffinity(cpus[i+1]);
+    }
+}
+
+std::vector<EventLoop*> EventLoops::ioLoops() {
+    if(size_ == 0) {
+        return EventLoop::ioLoops();
+    }
+    std::vector<EventLoop*> loops;
+    for(auto &loop: subLoops_) {
+        loops.push_back(&loop);
+    }
+    return loops;
 }
 
 /// @brief  创建线程依次启动loops 以及loops全部结束回收线程
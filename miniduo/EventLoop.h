@@ -13,6 +13,8 @@
 #include "util.h"
 #include "poller.h"
 #include "channel.h"
+#include "mpscqueue.h"
+#include "function.h"
 
 namespace miniduo{
 
@@ -28,7 +30,24 @@ public:
     EventLoop();
     ~EventLoop();
     
-    typedef std::function<void()> Task;
+    // 只可移动，捕获不超过 64 字节时不分配堆内存
+    typedef SmallFunction<void()> Task;
+
+    /// 跨线程任务队列的统计
+    struct TaskQueueStats {
+        uint64_t tasksRun;         // 已执行的 queueInLoop 任务数
+        uint64_t wakeups;          // 实际写 eventfd 的次数
+        uint64_t coalescedWakeups; // 因 loop 已被唤醒而省去的 eventfd 写
+        uint64_t maxBatch;         // 单次 doPendingTasks 最多执行的任务数
+    };
+
+    /// 自旋与阻塞等待的时间统计
+    struct SpinStats {
+        uint64_t spinNs;   // 非阻塞 poll 自旋的总时间
+        uint64_t sleepNs;  // 阻塞在 poll 中的总时间
+        uint64_t spinHits; // 自旋期间等到事件或任务的次数
+        uint64_t sleeps;   // 自旋预算耗尽后阻塞 poll 的次数
+    };
 
     void loop();
     void quit();
@@ -39,17 +58,73 @@ public:
     // thread safe (RunInLoop)
     void removeChannel(Channel* channel);
     // Thread safe (RunInLoop)
+    // 在 loop 线程中调用时 runAfter/runEvery 从 pollReturnTime() 开始计时，不读取时钟
     TimerId runAt(const Timestamp time, const TimerCallback &cb);
     TimerId runAfter(double delay, const TimerCallback &cb);
     TimerId runEvery(double interval, const TimerCallback &cb);
     // Thread safe (RunInLoop)
     void cancel(TimerId timerId);
-
-    void runInLoop(const Task& cb);
-    void queueInLoop(const Task& cb);
+    /// @brief 粗粒度定时器 (分层时间轮，精度 100ms)，加入或刷新都是 O(1) 且不分配内存，
+    /// 适合每个连接一个的超时；用 timer->cancel() 取消
+    /// Not thread safe, 在 loop 线程中调用
+    void addWheelTimer(WheelTimer* timer, double delay);
+
+    // 任意可调用对象隐式构造为 Task 后移动进队列，不再拷贝 std::function
+    void runInLoop(Task&& cb);
+    // thread safe, lock free; loop 已被唤醒且尚未处理任务时不再写 eventfd
+    void queueInLoop(Task&& cb);
     void wakeup();
+    // thread safe, 计数为近似值
+    TaskQueueStats taskQueueStats() const;
+
+    /// @brief 阻塞 poll 前先以 timeout=0 自旋 poll 并检查任务队列，最多 usec 微秒
+    /// 0 (默认) 表示直接阻塞。Not thread safe, 在 loop() 之前调用
+    void setSpinBudget(int usec) { spinBudgetUs_ = usec; }
+    /// @brief loop() 开始时将 loop 线程绑定到 cpu，-1 (默认) 表示不绑定
+    /// Not thread safe, 在 loop() 之前调用
+    void setCpuAffinity(int cpu) { cpuAffinity_ = cpu; }
+    // thread safe, 计数为近似值
+    SpinStats spinStats() const;
+
+    // 负载计数，由 TcpConnection 维护，供 EventLoops 选择新连接的 loop
+    // thread safe
+    void addConnectionLoad(int delta) {
+        connectionLoad_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    // thread safe
+    void addPendingBytes(int64_t delta) {
+        pendingBytes_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int connectionLoad() const { return connectionLoad_.load(std::memory_order_relaxed); }
+    // 所有连接输出缓冲中尚未写入 socket 的字节数
+    int64_t pendingBytes() const { return pendingBytes_.load(std::memory_order_relaxed); }
+
+    // 缓冲区内存计数，由 TcpConnection 维护
+    // thread safe
+    void addBufferBytes(int64_t delta) {
+        bufferBytes_.fetch_add(delta, std::memory_order_relaxed);
+    }
+    // 所有连接的 input/output 缓冲区占用的内存
+    int64_t bufferBytes() const { return bufferBytes_.load(std::memory_order_relaxed); }
+    /// @brief 新连接 input buffer 的初始大小，thread safe
+    size_t bufferSizeHint() const { return bufferSizeHint_.load(std::memory_order_relaxed); }
+    /// @brief 计入一个连接在空闲或关闭前 input buffer 的峰值，平滑后作为 bufferSizeHint()
+    /// thread safe, 并发更新时可能丢失一次观察
+    void observeBufferPeak(size_t peak);
     
     virtual EventLoop* allocLoop();
+    /// @brief 所有负责连接 IO 的 loop，即 allocLoop() 可能返回的 loop
+    virtual std::vector<EventLoop*> ioLoops();
+    /// @brief 返回 io_uring poller，用于 completion-based IO；
+    /// 当前 poller 不是 io_uring 时返回 nullptr
+    IoUringPoller* ioUringPoller();
+    bool supportsEdgeTriggered() const { return poller_->supportsEdgeTriggered(); }
+    /// @brief loop 线程缓存的时钟，每轮 poll 返回后刷新一次，读取时不再调用 clock_gettime
+    /// 在 IO 回调、定时器和任务中与当前时间相差不超过本轮已处理的耗时。Not thread safe
+    // wall clock, 即最近一次 poll 返回的时间
+    Timestamp pollReturnTime() const { return pollReturnTime_; }
+    // monotonic clock (util::getMonotonicNow()), 不受系统时间调整影响
+    Timestamp monotonicTime() const { return monotonicTime_; }
 
     void assertInLoopThread() {
         if(!isInLoopThread()){
@@ -65,6 +140,12 @@ private:
     void abortNotInLoopThread();
     void handleRead(Timestamp recvTime);
     void doPendingTasks();
+    // 按自旋预算等待 IO 事件，返回 poll 时间
+    Timestamp pollEvents();
+    Timestamp pollBlocking();
+    void bindCpu();
+    // loop 线程中返回缓存的 pollReturnTime_，其他线程读取时钟
+    Timestamp cachedOrCurrentTime();
 
     void settid(pid_t tid) {
         tid_ = tid;
@@ -79,8 +160,27 @@ private:
 
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_;
-    std::mutex mutex_;
-    std::vector<Task> pendingTasks_; // Guarded by mutex_
+    MpscQueue<Task> pendingTasks_;
+    std::vector<Task> runningTasks_;
+    // 自上次处理任务后是否已写过 eventfd, 用于合并唤醒
+    std::atomic<bool> wakeupPending_;
+    std::atomic<uint64_t> tasksRun_;
+    std::atomic<uint64_t> wakeups_;
+    std::atomic<uint64_t> maxBatch_;
+
+    int spinBudgetUs_;
+    int cpuAffinity_;
+    std::atomic<uint64_t> spinNs_;
+    std::atomic<uint64_t> sleepNs_;
+    std::atomic<uint64_t> spinHits_;
+    std::atomic<uint64_t> sleeps_;
+
+    std::atomic<int> connectionLoad_;
+    std::atomic<int64_t> pendingBytes_;
+    std::atomic<int64_t> bufferBytes_;
+    std::atomic<size_t> bufferSizeHint_;
+    Timestamp pollReturnTime_;
+    Timestamp monotonicTime_;
 
     pid_t tid_; // looping thread tid
     
@@ -89,16 +189,36 @@ private:
 class EventLoops: public EventLoop {
     
 public:
+    /// allocLoop() 选择 sub loop 的策略
+    enum class PlacementPolicy {
+        kRoundRobin,        // 轮转 (默认)
+        kLeastConnections,  // 连接数最少
+        kLeastPendingBytes, // 待发送字节数最少，相同时连接数最少
+        kPowerOfTwoChoices, // 随机取两个，选连接数较少的
+    };
+
     EventLoops(int loopNum = 0);
     ~EventLoops();
     void loop();
     void quit(); // FIXME: override or not?
     virtual EventLoop* allocLoop() override;
+    virtual std::vector<EventLoop*> ioLoops() override;
+    // Not thread safe, 在 loop() 之前调用
+    void setPlacementPolicy(PlacementPolicy policy) { policy_ = policy; }
+    // 设置主 loop 及所有 sub loop 的自旋预算
+    void setSpinBudget(int usec);
+    /// @brief cpus[0] 为主 loop 绑定的 cpu，cpus[i] 为第 i 个 sub loop 的，
+    /// 不足或为 -1 的不绑定
+    void setCpuAffinity(const std::vector<int>& cpus);
 
 private:
+    int leastLoaded(bool byPendingBytes);
+    int powerOfTwoChoices();
+
     std::vector<EventLoop> subLoops_;
     const int size_; // sub loop 的数量
-    std::atomic<int> next_;
+    std::atomic<unsigned> next_;
+    PlacementPolicy policy_;
 
 };
 
@@ -1,18 +1,21 @@
 #include "buffer.h"
 
 #include <sys/uio.h> // readv(2)
+#include <sys/ioctl.h> // FIONREAD
+#include <unistd.h> // read(2)
+#include <errno.h>
 
 using namespace miniduo;
 
 const char Buffer::kCRLF[] = "\r\n";
 // begin member functions of class Buffer;
-Buffer::Buffer()
-    : buffer_(kCheapPrepend + kInitialSize),
+Buffer::Buffer(size_t initialSize)
+    : buffer_(kCheapPrepend + initialSize),
       readerIndex_(kCheapPrepend),
       writerIndex_(readerIndex_)
 {
     assert(readableBytes() == 0);
-    assert(writableBytes() == kInitialSize);
+    assert(writableBytes() == initialSize);
     assert(prependableBytes() == kCheapPrepend);
 }
 
@@ -102,9 +105,12 @@ void Buffer::prepend(const void* data, size_t len) {
 }
 
 void Buffer::shrink(size_t reserve) {
-    std::vector<char> buf(kCheapPrepend+readableBytes()+reserve);
-    std::copy(beginRead(), beginRead()+readableBytes(), buf.begin() + kCheapPrepend);
+    const size_t readable = readableBytes();
+    std::vector<char> buf(kCheapPrepend+readable+reserve);
+    std::copy(beginRead(), beginRead()+readable, buf.begin() + kCheapPrepend);
     buffer_.swap(buf);
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = kCheapPrepend + readable;
     assert(writableBytes() == reserve);
 }
 
@@ -130,6 +136,28 @@ ssize_t Buffer::readFd(int fd, int* saveErrno) {
     return n;
 }
 
+ssize_t Buffer::readFdDirect(int fd, size_t minWritable, int* saveErrno) {
+    makeSpace(minWritable);
+    const size_t writable = writableBytes();
+    ssize_t n = ::read(fd, beginWrite(), writable);
+    if(n < 0) {
+        *saveErrno = errno;
+        return n;
+    }
+    writerIndex_ += n;
+    int avail = 0;
+    if(static_cast<size_t>(n) == writable && ::ioctl(fd, FIONREAD, &avail) == 0 && avail > 0) {
+        // 剩余数据按实际大小一次读入，只扩展一次
+        makeSpace(avail);
+        ssize_t m = ::read(fd, beginWrite(), writableBytes());
+        if(m > 0) {
+            writerIndex_ += m;
+            n += m;
+        }
+    }
+    return n;
+}
+
 char* Buffer::begin() {
     return &*(buffer_.begin());
 }
@@ -142,7 +170,7 @@ void Buffer::makeSpace(size_t len) {
     if(writableBytes() >= len) return;
     if(prependableBytes()-kCheapPrepend+writableBytes() >= len) {
         size_t readable = readableBytes();
-        std::copy(begin(), beginWrite(), buffer_.begin()+kCheapPrepend);
+        std::copy(begin() + readerIndex_, beginWrite(), buffer_.begin()+kCheapPrepend);
         writerIndex_ = kCheapPrepend + readable;
         readerIndex_ = kCheapPrepend;        
     }
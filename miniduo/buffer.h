@@ -15,12 +15,14 @@ public:
     static const size_t kInitialSize = 1024;
     static const char kCRLF[];
 
-    Buffer();
+    explicit Buffer(size_t initialSize = kInitialSize);
 
     void swap(Buffer& rhs);
     size_t readableBytes() const;
     size_t writableBytes() const;
     size_t prependableBytes() const;
+    // 已分配的内存
+    size_t capacity() const { return buffer_.capacity(); }
     // begin ptr of readable data;
     const char* beginRead() const ;
     // retrieve readable data;
@@ -42,6 +44,9 @@ public:
     void shrink(size_t reserve);
     /// @brief use readv(2) to read data from fd into buffer;
     ssize_t readFd(int fd, int* savedErrno);
+    /// @brief 直接 read(2) 到 buffer 中，不经过栈上的 extrabuf 再拷贝一次；
+    /// 先保证至少 minWritable 字节的可写空间，读满时按 FIONREAD 扩展后再读一次剩余数据
+    ssize_t readFdDirect(int fd, size_t minWritable, int* savedErrno);
 
     /// @brief  make space for write data with length of 'len';
     void makeSpace(size_t len);
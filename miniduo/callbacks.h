@@ -20,4 +20,8 @@ typedef std::function<void (const TcpConnectionPtr&,
                             Timestamp)> MsgCallback;
 typedef std::function<void (const TcpConnectionPtr&)> CloseCallback;
 typedef std::function<void (const TcpConnectionPtr&)> WriteCompleteCallback;
+// 待发送的字节数升到高水位时回调，参数为当前待发送的字节数
+typedef std::function<void (const TcpConnectionPtr&, size_t)> HighWaterMarkCallback;
+// 超过高水位后待发送的字节数降到低水位时回调
+typedef std::function<void (const TcpConnectionPtr&)> LowWaterMarkCallback;
 } // namespace miniduo
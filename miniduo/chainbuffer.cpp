@@ -0,0 +1,226 @@
+#include "chainbuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+using namespace miniduo;
+
+namespace {
+
+struct BlockCache {
+    std::vector<char*> blocks;
+    ~BlockCache() {
+        for(char* block: blocks) {
+            delete[] block;
+        }
+    }
+};
+
+thread_local BlockCache t_blockCache;
+
+} // namespace
+
+const size_t BlockPool::kBlockSize;
+const size_t BlockPool::kMaxCachedBlocks;
+
+// begin member functions of class BlockPool;
+char* BlockPool::get() {
+    std::vector<char*>& blocks = t_blockCache.blocks;
+    if(blocks.empty()) {
+        return new char[kBlockSize];
+    }
+    char* block = blocks.back();
+    blocks.pop_back();
+    return block;
+}
+
+void BlockPool::put(char* block) {
+    std::vector<char*>& blocks = t_blockCache.blocks;
+    if(blocks.size() < kMaxCachedBlocks) {
+        blocks.push_back(block);
+    }
+    else {
+        delete[] block;
+    }
+}
+
+size_t BlockPool::cached() {
+    return t_blockCache.blocks.size();
+}
+// end member functions of class BlockPool;
+
+// begin member functions of class ChainBuffer;
+const int ChainBuffer::kMaxIov;
+const int ChainBuffer::kMaxReadBlocks;
+
+ChainBuffer::ChainBuffer()
+    : readable_(0)
+{
+}
+
+ChainBuffer::~ChainBuffer() {
+    for(Block& block: blocks_) {
+        BlockPool::put(block.data);
+    }
+}
+
+void ChainBuffer::swap(ChainBuffer& rhs) {
+    blocks_.swap(rhs.blocks_);
+    std::swap(readable_, rhs.readable_);
+}
+
+size_t ChainBuffer::writableBytes() const {
+    return blocks_.empty() ? 0 : BlockPool::kBlockSize - blocks_.back().writeIndex;
+}
+
+void ChainBuffer::popFront() {
+    BlockPool::put(blocks_.front().data);
+    blocks_.pop_front();
+}
+
+void ChainBuffer::retrieve(size_t len) {
+    assert(len <= readable_);
+    readable_ -= len;
+    while(len > 0) {
+        Block& front = blocks_.front();
+        size_t n = std::min(len, front.writeIndex - front.readIndex);
+        front.readIndex += n;
+        len -= n;
+        if(front.readIndex == front.writeIndex && front.writeIndex == BlockPool::kBlockSize) {
+            popFront(); // 读完且不再可写的块立即归还
+        }
+    }
+    if(readable_ == 0) {
+        retrieveAll();
+    }
+}
+
+void ChainBuffer::retrieveAll() {
+    // 保留一个块作为下一次写入的空间
+    while(blocks_.size() > 1) {
+        popFront();
+    }
+    if(!blocks_.empty()) {
+        blocks_.front().readIndex = 0;
+        blocks_.front().writeIndex = 0;
+    }
+    readable_ = 0;
+}
+
+std::string ChainBuffer::retrieveAsString() {
+    return retrieveAsString(readable_);
+}
+
+std::string ChainBuffer::retrieveAsString(size_t len) {
+    assert(len <= readable_);
+    std::string str(len, '\0');
+    copyOut(&str[0], len);
+    retrieve(len);
+    return str;
+}
+
+void ChainBuffer::append(const std::string& str) {
+    append(str.data(), str.size());
+}
+
+void ChainBuffer::append(const char* data, size_t len) {
+    readable_ += len;
+    while(len > 0) {
+        if(writableBytes() == 0) {
+            blocks_.push_back({BlockPool::get(), 0, 0});
+        }
+        Block& back = blocks_.back();
+        size_t n = std::min(len, BlockPool::kBlockSize - back.writeIndex);
+        ::memcpy(back.data + back.writeIndex, data, n);
+        back.writeIndex += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::append(const void* data, size_t len) {
+    append(static_cast<const char*>(data), len);
+}
+
+int ChainBuffer::peek(struct iovec* iov, int maxIov) const {
+    int count = 0;
+    for(auto it = blocks_.begin(); it != blocks_.end() && count < maxIov; ++it) {
+        if(it->writeIndex > it->readIndex) {
+            iov[count].iov_base = it->data + it->readIndex;
+            iov[count].iov_len = it->writeIndex - it->readIndex;
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t ChainBuffer::copyOut(char* dst, size_t len) const {
+    size_t copied = 0;
+    for(auto it = blocks_.begin(); it != blocks_.end() && copied < len; ++it) {
+        size_t n = std::min(len - copied, it->writeIndex - it->readIndex);
+        ::memcpy(dst + copied, it->data + it->readIndex, n);
+        copied += n;
+    }
+    return copied;
+}
+
+ssize_t ChainBuffer::readFd(int fd, int* savedErrno) {
+    struct iovec vec[kMaxReadBlocks + 1];
+    char* fresh[kMaxReadBlocks];
+    int count = 0;
+    const size_t tailWritable = writableBytes();
+    if(tailWritable > 0) {
+        Block& back = blocks_.back();
+        vec[count].iov_base = back.data + back.writeIndex;
+        vec[count].iov_len = tailWritable;
+        count++;
+    }
+    for(int i=0; i<kMaxReadBlocks; i++) {
+        fresh[i] = BlockPool::get();
+        vec[count].iov_base = fresh[i];
+        vec[count].iov_len = BlockPool::kBlockSize;
+        count++;
+    }
+    const ssize_t n = ::readv(fd, vec, count);
+    if(n < 0) {
+        *savedErrno = errno;
+    }
+    size_t remain = n > 0 ? static_cast<size_t>(n) : 0;
+    readable_ += remain;
+    if(tailWritable > 0) {
+        size_t used = std::min(remain, tailWritable);
+        blocks_.back().writeIndex += used;
+        remain -= used;
+    }
+    for(int i=0; i<kMaxReadBlocks; i++) {
+        if(remain > 0) {
+            size_t used = std::min(remain, BlockPool::kBlockSize);
+            blocks_.push_back({fresh[i], 0, used});
+            remain -= used;
+        }
+        else {
+            BlockPool::put(fresh[i]);
+        }
+    }
+    return n;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int* savedErrno) {
+    struct iovec vec[kMaxIov];
+    int count = peek(vec, kMaxIov);
+    if(count == 0) {
+        return 0;
+    }
+    const ssize_t n = ::writev(fd, vec, count);
+    if(n < 0) {
+        *savedErrno = errno;
+    }
+    else {
+        retrieve(n);
+    }
+    return n;
+}
+// end member functions of class ChainBuffer;
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <sys/types.h> // ssize_t
+#include <sys/uio.h>   // struct iovec
+
+namespace miniduo
+{
+
+/// 固定大小内存块的线程局部缓存池
+/// 块在哪个线程释放就缓存到哪个线程，超过上限时归还给系统
+class BlockPool {
+public:
+    static const size_t kBlockSize = 8192;
+    static const size_t kMaxCachedBlocks = 256; // 每个线程最多缓存 2MB
+
+    static char* get();
+    static void put(char* block);
+    // 当前线程缓存的块数
+    static size_t cached();
+};
+
+/// 由固定大小内存块链组成的缓冲区，append / retrieve / readFd 语义与 Buffer 一致
+/// 扩容只在链尾追加新块，不会移动或拷贝已有数据；可读数据不连续，
+/// 通过 peek() 以 iovec 形式访问，writeFd() 用 writev(2) 一次写出多个块
+class ChainBuffer {
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+public:
+    static const int kMaxIov = 64;
+
+    ChainBuffer();
+    ~ChainBuffer();
+
+    void swap(ChainBuffer& rhs);
+    size_t readableBytes() const { return readable_; }
+    // 链尾块中剩余的可写空间
+    size_t writableBytes() const;
+    // 占用的块数
+    size_t blockCount() const { return blocks_.size(); }
+
+    void retrieve(size_t len);
+    void retrieveAll();
+    std::string retrieveAsString();
+    std::string retrieveAsString(size_t len);
+    void append(const std::string& str);
+    void append(const char* data, size_t len);
+    void append(const void* data, size_t len);
+
+    /// @brief 填充最多 maxIov 个 iovec 指向可读数据，返回填充的个数
+    int peek(struct iovec* iov, int maxIov) const;
+    /// @brief 拷贝最多 len 字节可读数据到 dst，不取出，返回拷贝的字节数
+    size_t copyOut(char* dst, size_t len) const;
+
+    /// @brief use readv(2) to read data from fd into buffer;
+    /// 直接读入链尾剩余空间及新取的块，不经过栈上的 extrabuf
+    ssize_t readFd(int fd, int* savedErrno);
+    /// @brief use writev(2) to write readable data to fd, and retrieve the written bytes
+    ssize_t writeFd(int fd, int* savedErrno);
+
+private:
+    struct Block {
+        char* data;
+        size_t readIndex;
+        size_t writeIndex;
+    };
+    // 一次 readFd 最多新取的块数，与 Buffer::readFd 的 64k extrabuf 相当
+    static const int kMaxReadBlocks = 65536 / BlockPool::kBlockSize;
+
+    void popFront();
+
+    std::deque<Block> blocks_;
+    size_t readable_;
+
+}; // class ChainBuffer
+
+} // namespace miniduo
@@ -3,18 +3,24 @@
 #include "logging.h"
 
 #include <poll.h>
+#include <sys/epoll.h> // EPOLLET
+
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::NET
 
 using namespace miniduo;
 
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = POLLIN | POLLPRI;
 const int Channel::kWriteEvent = POLLOUT;
+const int Channel::kEdgeTriggered = EPOLLET;
 
 Channel::Channel(EventLoop* loop, int fdArg)
     : loop_(loop),
       fd_(fdArg),
       events_(0),
-      revents_(0)
+      revents_(0),
+      edgeTriggered_(false)
 {
 
 }
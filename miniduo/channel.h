@@ -2,6 +2,7 @@
 
 #include <functional> // function<T>
 #include "util.h" // Timestamp
+#include "function.h" // SmallFunction
 // #include "EventLoop.h"
 
 namespace miniduo{
@@ -13,24 +14,25 @@ class Channel{
     Channel& operator=(const Channel&) = delete;
 
 public:
-    typedef std::function<void()> EventCallback;
-    typedef std::function<void(Timestamp)> ReadEventCallback;
+    typedef SmallFunction<void()> EventCallback;
+    typedef SmallFunction<void(Timestamp)> ReadEventCallback;
     Channel(EventLoop* loop, int fd);
 
     void handleEvent(Timestamp recvTime);
-    void setReadCallback(const ReadEventCallback& cb){
-        readCallback_ = cb;
+    void setReadCallback(ReadEventCallback cb){
+        readCallback_ = std::move(cb);
     }
-    void setWriteCallback(const EventCallback& cb){
-        writeCallback_ = cb;
+    void setWriteCallback(EventCallback cb){
+        writeCallback_ = std::move(cb);
     }
-    void setErrorCallback(const EventCallback& cb){
-        errorCallback_ =cb;
+    void setErrorCallback(EventCallback cb){
+        errorCallback_ = std::move(cb);
     }
     
 
     int fd() const { return fd_; }
-    int events() const { return events_; }          
+    // 包含 edge-triggered 标志 (EPOLLET)，poll(2) 会忽略该位
+    int events() const { return edgeTriggered_ ? events_ | kEdgeTriggered : events_; }
     void setRevents(int revt) { revents_ = revt; }
     bool isNoneEvent() const { return events_ == kNoneEvent; }
     bool isWriting() const { return events_ & kWriteEvent; }
@@ -38,6 +40,9 @@ public:
     void enableReading(bool enable);
     void enableWriting(bool enable);
     void disableAll() { events_ = kNoneEvent; update(); }
+    /// @brief 设置 edge-triggered，只有 EPollPoller 支持，下次 update 时生效
+    void setEdgeTriggered(bool enable) { edgeTriggered_ = enable; }
+    bool isEdgeTriggered() const { return edgeTriggered_; }
 
     EventLoop* ownerLoop() { return loop_; }
 
@@ -47,11 +52,13 @@ private:
     static const int kNoneEvent;
     static const int kReadEvent;
     static const int kWriteEvent;
+    static const int kEdgeTriggered;
 
     EventLoop* loop_;
     const int  fd_;
     int        events_;  // channel 关心的 IO 事件
     int        revents_; // 当前活动的事件，由 EventLoop/Poller 设置
+    bool       edgeTriggered_;
 
     ReadEventCallback readCallback_;
     EventCallback writeCallback_;
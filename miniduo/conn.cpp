@@ -5,20 +5,37 @@
 #include "logging.h"
 
 #include <unistd.h>
+#include <sys/uio.h> // writev()
 #include <functional>
 #include <cassert>
  #include <sys/sendfile.h> // sendfile()
+#include <poll.h> // POLLOUT
+#include <cstring> // memset()
+#include <linux/errqueue.h> // sock_extended_err
+#include <netinet/in.h> // IP_RECVERR, IPV6_RECVERR
+#include <mutex>
+#include <condition_variable>
+
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::NET
 
 using namespace miniduo;
 // using namespace socket;
 
-Acceptor::Acceptor(EventLoop* loop, const SockAddr& listenAddr) 
+namespace {
+const int kMaxIov = 64; // 一次 writev 最多写出的片段数
+} // namespace
+
+Acceptor::Acceptor(EventLoop* loop, const SockAddr& listenAddr, bool reusePort) 
     : loop_(loop),
       acceptFd_(socket::createNonblockingSock()),
       acceptChannel_(loop, acceptFd_),
       listening_(false)
 {
     socket::setReuseAddr(acceptFd_);
+    if(reusePort) {
+        socket::setReusePort(acceptFd_);
+    }
     socket::bindAddr(acceptFd_, listenAddr);
     acceptChannel_.setReadCallback(
         std::bind(&Acceptor::handleRead, this, std::placeholders::_1));
@@ -33,6 +50,15 @@ void Acceptor::listen() {
     acceptChannel_.enableReading(true);
 }
 
+void Acceptor::stop() {
+    loop_->assertInLoopThread();
+    if(listening_) {
+        listening_ = false;
+        acceptChannel_.disableAll();
+        loop_->removeChannel(&acceptChannel_);
+    }
+}
+
 void Acceptor::handleRead(Timestamp recvTime) {
     loop_->assertInLoopThread();
     SockAddr peerAddr(0);
@@ -53,72 +79,145 @@ void Acceptor::handleRead(Timestamp recvTime) {
 TcpServer::TcpServer(EventLoop* loop, const SockAddr& listenAddr)
     : loop_(loop),
       name_(listenAddr.addrString()),
-      acceptor_(new Acceptor(loop, listenAddr)),
+      listenAddr_(listenAddr),
+      highWaterMark_(64 * 1024 * 1024),
+      lowWaterMark_(0),
+      pauseReadOnHighWater_(false),
       started_(false),
+      completionMode_(false),
+      edgeTriggered_(false),
+      busyPollUs_(0),
+      reusePort_(false),
+      zeroCopyThreshold_(0),
+      bufferIdleTimeout_(0),
+      idleTimeout_(0),
+      directRead_(false),
       nextConnId_(1)
 {
-    acceptor_->setNewConnectionCallback(
-        std::bind(&TcpServer::newConnection, this, 
-            std::placeholders::_1, std::placeholders::_2));
 }
 
 TcpServer::~TcpServer() {
     loop_->assertInLoopThread();
     log_trace("TcpServer::~TcpServer");
+    for(auto& listener: listeners_) {
+        Listener* l = listener.get();
+        if(l->loop == loop_) {
+            closeListener(l);
+            continue;
+        }
+        // reusePort 模式: acceptor 与连接表只在 sub loop 中访问，
+        // 在 sub loop 中清理并等待完成，之后才能释放 Listener
+        std::mutex mut;
+        std::condition_variable cond;
+        bool done = false;
+        l->loop->runInLoop([this, l, &mut, &cond, &done] {
+            closeListener(l);
+            std::lock_guard<std::mutex> lock(mut);
+            done = true;
+            cond.notify_one();
+        });
+        std::unique_lock<std::mutex> lock(mut);
+        cond.wait(lock, [&done] { return done; });
+    }
+}
+
+void TcpServer::closeListener(Listener* listener) {
+    listener->loop->assertInLoopThread();
+    listener->acceptor->stop();
     // 释放所有TcpConn
-    for(auto& item: connections_) {
+    for(auto& item: listener->connections) {
         TcpConnectionPtr conn(item.second);
         item.second.reset();
         conn->getLoop()->runInLoop(
             std::bind(&TcpConnection::connectDestroyed, conn)
         );
     }
+    listener->connections.clear();
 }
 
 void TcpServer::start() {
-    if(!started_) {
-        started_ = true;
+    if(started_) {
+        return;
     }
-    if(!acceptor_->listenning()) {
-        loop_->runInLoop(
-            std::bind(&Acceptor::listen, acceptor_.get()));
+    started_ = true;
+    if(reusePort_) {
+        for(EventLoop* ioLoop: loop_->ioLoops()) {
+            addListener(ioLoop);
+        }
+    }
+    else {
+        addListener(loop_);
+    }
+    for(auto& listener: listeners_) {
+        listener->loop->runInLoop(
+            std::bind(&Acceptor::listen, listener->acceptor.get()));
     }
 }
 
+int64_t TcpServer::bufferBytes() const {
+    int64_t bytes = 0;
+    for(EventLoop* ioLoop: loop_->ioLoops()) {
+        bytes += ioLoop->bufferBytes();
+    }
+    return bytes;
+}
 
-void TcpServer::newConnection(int sockfd, const SockAddr& peerAddr) {
-    loop_->assertInLoopThread();
+void TcpServer::addListener(EventLoop* loop) {
+    std::unique_ptr<Listener> listener(new Listener);
+    listener->loop = loop;
+    listener->acceptor.reset(new Acceptor(loop, listenAddr_, reusePort_));
+    listener->acceptor->setNewConnectionCallback(
+        std::bind(&TcpServer::newConnection, this, listener.get(),
+            std::placeholders::_1, std::placeholders::_2));
+    listeners_.push_back(std::move(listener));
+}
+
+
+void TcpServer::newConnection(Listener* listener, int sockfd, const SockAddr& peerAddr) {
+    listener->loop->assertInLoopThread();
     char buf[32] = {0};
-    snprintf(buf, sizeof(buf), "#%d", nextConnId_);
-    ++nextConnId_;
+    snprintf(buf, sizeof(buf), "#%d", nextConnId_.fetch_add(1, std::memory_order_relaxed));
     std::string connName = name_ + buf;
     log_info("TcpServer::newConnection [%s] - new connection [%s] from %s", 
             name_.c_str(), connName.c_str(), peerAddr.addrString().c_str());
     SockAddr localAddr(socket::getLocalAddr(sockfd));
-    EventLoop* ioLoop = loop_->allocLoop();
+    if(busyPollUs_ > 0) {
+        socket::setBusyPoll(sockfd, busyPollUs_);
+    }
+    // reusePort 模式下连接留在接受它的 loop 中
+    EventLoop* ioLoop = reusePort_ ? listener->loop : loop_->allocLoop();
     assert(ioLoop != nullptr);
     TcpConnectionPtr conn( new TcpConnection(ioLoop, connName, sockfd, localAddr, peerAddr));
-    connections_[connName] = conn;
+    listener->connections[connName] = conn;
     conn->setConnectionCallback(connectionCallback_);
     conn->setMsgCallback(msgCallback_);
     conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+        std::bind(&TcpServer::removeConnection, this, listener, std::placeholders::_1));
     conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setHighWaterMarkCallback(highWaterMarkCallback_, highWaterMark_);
+    conn->setLowWaterMarkCallback(lowWaterMarkCallback_, lowWaterMark_);
+    conn->setPauseReadOnHighWater(pauseReadOnHighWater_);
+    conn->setCompletionMode(completionMode_);
+    conn->setEdgeTriggered(edgeTriggered_);
+    conn->setZeroCopyThreshold(zeroCopyThreshold_);
+    conn->setBufferIdleTimeout(bufferIdleTimeout_);
+    conn->setIdleTimeout(idleTimeout_);
+    conn->setDirectRead(directRead_);
     conn->getLoop()->runInLoop([conn] {conn->connectEstablished();});
     // conn->connectEstablished();
 
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr& conn) {
+void TcpServer::removeConnection(Listener* listener, const TcpConnectionPtr& conn) {
     log_trace("step into");
-    loop_->runInLoop([this, conn] {removeConnectionInLoop(conn);});
+    listener->loop->runInLoop([this, listener, conn] {removeConnectionInLoop(listener, conn);});
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr& conn) {
-    loop_->assertInLoopThread();
+void TcpServer::removeConnectionInLoop(Listener* listener, const TcpConnectionPtr& conn) {
+    listener->loop->assertInLoopThread();
     log_info("TcpServer::removeConnection [%s] - connection", conn->name().c_str());
-    assert( connections_.find(conn->name()) != connections_.end() );
-    size_t n = connections_.erase(conn->name());
+    assert( listener->connections.find(conn->name()) != listener->connections.end() );
+    size_t n = listener->connections.erase(conn->name());
     assert(n == 1);
     // queueInLoop: 确保 TcpConn 不会在 IO 处理中handleclose析构
     conn->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));   
@@ -133,34 +232,150 @@ TcpConnection::TcpConnection(EventLoop* loop,
     : loop_(loop),
       name_(name),
       state_(StateE::kConnecting),
+      input_(loop->bufferSizeHint()),
       sockFd_(sockfd),
       connChannel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
-      peerAddr_(peerAddr)
+      peerAddr_(peerAddr),
+      highWaterMark_(64 * 1024 * 1024),
+      lowWaterMark_(0),
+      pauseReadOnHighWater_(false),
+      aboveHighWater_(false),
+      readPausedByUser_(false),
+      readPausedByWater_(false),
+      reading_(true),
+      reportedPendingBytes_(0),
+      reportedBufferBytes_(0),
+      inputPeak_(0),
+      bufferIdleTimeout_(0),
+      ioCount_(0),
+      idleCheckCount_(0),
+      idleTimeout_(0),
+      lastActive_(0),
+      slicesBytes_(0),
+      directRead_(false),
+      edgeTriggered_(false),
+      socketWritable_(true),
+      writeCompletePending_(false),
+      uring_(nullptr),
+      recvOp_(0),
+      recvSize_(Buffer::kInitialSize),
+      sendOp_(0),
+      zeroCopyThreshold_(0),
+      zcNextSeq_(0),
+      zcAcked_(0),
+      zcWriteCompletePending_(false)
 {
     assert(loop_ != nullptr);
     log_debug("TcpConnection::ctor [%s] at %p fd=%d", name_.c_str(), this, sockfd);
+    // 在 allocLoop() 之后立即计入，连续 accept 时后续的选择能看到本连接
+    loop_->addConnectionLoad(1);
     connChannel_->setReadCallback(
         std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
     );
     connChannel_->setWriteCallback(
         std::bind(&TcpConnection::handleWrite, this)
     );
+    idleTimer_.setCallback(std::bind(&TcpConnection::checkIdle, this));
+    timeoutTimer_.setCallback(std::bind(&TcpConnection::checkIdleTimeout, this));
 
 
 }
 
 TcpConnection::~TcpConnection() {
     log_trace("TcpConnection::dtor [%s] at %p fd=%d", name_.c_str(), this, sockFd_);
+    if(zcAcked_ != zcNextSeq_) {
+        zcWriteCompletePending_ = false; // 析构中不再回调
+        reapZeroCopy();
+    }
+    if(zcAcked_ != zcNextSeq_) {
+        // 内核仍引用 zcPending_ 及借用片段的内存，释放后可能被改写后才发出:
+        // 以 RST 关闭，丢弃发送队列中的数据
+        log_debug("TcpConnection [%s] aborts %u unacknowledged zerocopy sends",
+                  name_.c_str(), zcNextSeq_ - zcAcked_);
+        socket::setLinger(sockFd_, true, 0);
+    }
+    loop_->addConnectionLoad(-1);
+    loop_->addPendingBytes(-static_cast<int64_t>(reportedPendingBytes_));
+    loop_->addBufferBytes(-static_cast<int64_t>(reportedBufferBytes_));
     ::close(sockFd_);
 }
 
+void TcpConnection::setCompletionMode(bool enable) {
+    assert(state_ == StateE::kConnecting);
+    uring_ = enable ? loop_->ioUringPoller() : nullptr;
+    if(enable && uring_ == nullptr) {
+        log_warn("TcpConnection [%s] completion mode is not supported by the poller",
+                 name_.c_str());
+    }
+}
+
+void TcpConnection::setEdgeTriggered(bool enable) {
+    assert(state_ == StateE::kConnecting);
+    edgeTriggered_ = enable && uring_ == nullptr && loop_->supportsEdgeTriggered();
+    if(enable && !edgeTriggered_) {
+        log_trace("TcpConnection [%s] falls back to level-triggered", name_.c_str());
+    }
+}
+
+void TcpConnection::setDirectRead(bool enable) {
+    assert(state_ == StateE::kConnecting);
+    directRead_ = enable;
+}
+
+void TcpConnection::setBufferIdleTimeout(double seconds) {
+    assert(state_ == StateE::kConnecting);
+    bufferIdleTimeout_ = seconds;
+}
+
+void TcpConnection::setIdleTimeout(double seconds) {
+    assert(state_ == StateE::kConnecting);
+    idleTimeout_ = seconds;
+}
+
+void TcpConnection::setZeroCopyThreshold(size_t bytes) {
+    assert(state_ == StateE::kConnecting);
+    if(bytes == 0 || uring_ != nullptr) {
+        zeroCopyThreshold_ = 0;
+        return;
+    }
+    if(zeroCopyThreshold_ == 0 && !socket::setZeroCopy(sockFd_)) {
+        log_warn("TcpConnection [%s] SO_ZEROCOPY is not supported", name_.c_str());
+        return;
+    }
+    zeroCopyThreshold_ = std::max(bytes, kMinZeroCopySize);
+    // 完成通知通过 POLLERR 报告
+    connChannel_->setErrorCallback(
+        std::bind(&TcpConnection::handleErrorEvent, this)
+    );
+}
+
 void TcpConnection::connectEstablished() {
     loop_->assertInLoopThread();
     assert(state_ == StateE::kConnecting);
     setState(StateE::kConnected);
     loop_->addChannel(connChannel_.get());
-    connChannel_->enableReading(true);
+    if(uring_) {
+        // completion 模式下 channel 不关注任何事件，读写由 io_uring 操作驱动
+        startRecv();
+    }
+    else if(edgeTriggered_) {
+        connChannel_->setEdgeTriggered(true);
+        connChannel_->enableReading(true);
+        connChannel_->enableWriting(true);
+    }
+    else {
+        connChannel_->enableReading(true);
+    }
+    updateBufferBytes();
+    if(bufferIdleTimeout_ > 0) {
+        armIdleTimer();
+    }
+    lastActive_ = loop_->monotonicTime();
+    if(idleTimeout_ > 0) {
+        armTimeoutTimer(idleTimeout_);
+    }
+    updateReading(); // 建立前调用的 stopRead()
     connectionCallback_(shared_from_this());
 }
 
@@ -171,17 +386,29 @@ void TcpConnection::connectDestroyed() {
     if(state_ == StateE::kConnected) {
         setState(StateE::kDisconnected);
         connChannel_->disableAll();
+        cancelOps();
         connectionCallback_(shared_from_this());
     }
+    if(inputPeak_ > 0) {
+        loop_->observeBufferPeak(inputPeak_);
+        inputPeak_ = 0;
+    }
+    idleTimer_.cancel();
+    timeoutTimer_.cancel();
     loop_->removeChannel(connChannel_.get());
 }
 
 void TcpConnection::handleRead(Timestamp recvTime) {
+    if(edgeTriggered_) {
+        handleReadET(recvTime);
+        return;
+    }
     // char buf[65536];
     // ssize_t n = ::read(connChannel_->fd(), buf, sizeof(buf));
     int savedErrno;
-    ssize_t n = input_.readFd(connChannel_->fd(), &savedErrno);
+    ssize_t n = readInput(&savedErrno);
     if(n > 0) {
+        inputChanged();
         msgCallback_(shared_from_this(), &input_, recvTime);
     }
     else if(n==0) {
@@ -194,6 +421,18 @@ void TcpConnection::handleRead(Timestamp recvTime) {
     }
 }
 
+ssize_t TcpConnection::readInput(int* savedErrno) {
+    if(!directRead_) {
+        return input_.readFd(connChannel_->fd(), savedErrno);
+    }
+    ssize_t n = input_.readFdDirect(connChannel_->fd(), recvSize_, savedErrno);
+    // 与 completion 模式相同: 读到的数据达到预留的大小时，下次预留加倍
+    if(n > 0 && static_cast<size_t>(n) >= recvSize_ && recvSize_ < kMaxRecvSize) {
+        recvSize_ *= 2;
+    }
+    return n;
+}
+
 void TcpConnection::handleClose() {
     loop_->assertInLoopThread();
     log_trace("TcpConnection::handleClose state = %d", state_);
@@ -201,6 +440,9 @@ void TcpConnection::handleClose() {
             || state_ == StateE::kDisconnecting);
     setState(StateE::kDisconnected);
     connChannel_->disableAll();
+    cancelOps();
+    idleTimer_.cancel();
+    timeoutTimer_.cancel();
     connectionCallback_(shared_from_this());
     // loop_->queueInLoop(std::bind(closeCallback_, shared_from_this()));
     // TcpServer::removeConnection
@@ -213,25 +455,24 @@ void TcpConnection::handleError() {
 
 void TcpConnection::handleWrite() {
     loop_->assertInLoopThread();
+    if(edgeTriggered_) {
+        socketWritable_ = true;
+        flushOutputET();
+        return;
+    }
     if(connChannel_->isWriting()) 
     {
         ssize_t n = 0;
-        if(output_.readableBytes() > 0) {
-            n = write(connChannel_->fd(),
-                          output_.beginRead(),
-                          output_.readableBytes());
+        if(outputBytes() > 0) {
+            n = writeOutput();
         }
         if(n >= 0) 
         {
-            output_.retrieve(n);
-            if(output_.readableBytes() == 0) 
+            outputChanged();
+            if(outputBytes() == 0) 
             {
                 connChannel_->enableWriting(false);
-                if(writeCompleteCallback_) {
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
-                }
+                queueWriteComplete();
                 if(state_ == StateE::kDisconnecting) 
                 {
                     shutdownInLoop();
@@ -242,8 +483,9 @@ void TcpConnection::handleWrite() {
                 log_trace("More data to write");
             }
         }
-        else 
+        else if(errno != EAGAIN && errno != EWOULDBLOCK)
         {
+            // EAGAIN 时仍关注可写事件，等待下一次 POLLOUT
             log_error("TcpConnection::handleWrite");
         }
     }
@@ -263,7 +505,13 @@ void TcpConnection::shutdownInLoop() {
     loop_->assertInLoopThread();
     if(state_ == StateE::kConnected) {
         setState(StateE::kDisconnecting);
-        if(!connChannel_->isWriting()) {
+    }
+    // 输出数据发送完后 handleWrite 会再次调用本函数
+    if(state_ == StateE::kDisconnecting) {
+        bool writing = uring_ ? sendOp_ != 0
+                     : edgeTriggered_ ? outputBytes() > 0
+                     : connChannel_->isWriting();
+        if(!writing) {
             socket::shutdownWrite(connChannel_->fd());
         }
     }
@@ -304,11 +552,25 @@ void TcpConnection::closeInLoop() {
 
 void TcpConnection::send(const std::string& msg) {
     // if msg is empty, this call will only enable writeable event
-    assert(msg.size() >= 0); 
-    loop_->runInLoop(
-        std::bind(&TcpConnection::sendInLoop, this, msg)
-    );
+    if(loop_->isInLoopThread()) {
+        sendInLoop(msg);
+    }
+    else {
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::sendInLoop, this, msg)
+        );
+    }
+}
 
+void TcpConnection::send(std::string&& msg) {
+    if(loop_->isInLoopThread()) {
+        sendInLoop(msg);
+    }
+    else {
+        loop_->queueInLoop(
+            [this, msg = std::move(msg)] { sendInLoop(msg); }
+        );
+    }
 }
 
 
@@ -317,17 +579,693 @@ void TcpConnection::send(const std::string& msg) {
 /// @param msg 
 void TcpConnection::sendInLoop(const std::string& msg) {
     loop_->assertInLoopThread();
-    if(state_ == StateE::kConnected) {
+    if(state_ != StateE::kConnected) {
+        return;
+    }
+    if(uring_) {
         output_.append(msg.data(), msg.size());
-        if(!connChannel_->isWriting()) {
-            connChannel_->enableWriting(true);
+        if(sendOp_ == 0) {
+            startSend();
+        }
+        outputChanged();
+        return;
+    }
+    // output_ 为空时直接写 socket，一次写完则不需要关注可写事件 (省去两次 epoll_ctl)
+    size_t written = 0;
+    bool idle = edgeTriggered_ ? socketWritable_ : !connChannel_->isWriting();
+    if(idle && outputBytes() == 0 && !msg.empty()) {
+        ssize_t n = ::write(connChannel_->fd(), msg.data(), msg.size());
+        if(n >= 0) {
+            written = n;
+        }
+        else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+            socketWritable_ = false;
+        }
+        else {
+            log_error("TcpConnection::sendInLoop");
+        }
+        if(written == msg.size()) {
+            queueWriteComplete();
+            noteActivity();
+            return;
         }
     }
+    if(slicesBytes_ > 0) {
+        // 保持顺序: 已有片段排队时，新数据排在片段之后
+        if(written < msg.size()) {
+            std::string rest(msg.data() + written, msg.size() - written);
+            slicesBytes_ += rest.size();
+            slices_.emplace_back(std::move(rest));
+        }
+    }
+    else {
+        output_.append(msg.data() + written, msg.size() - written);
+    }
+    if(edgeTriggered_) {
+        if(msg.empty()) {
+            writeCompletePending_ = true;
+        }
+        if(socketWritable_) {
+            flushOutputET();
+        }
+    }
+    else if(!connChannel_->isWriting()) {
+        connChannel_->enableWriting(true);
+    }
+    outputChanged();
 }
 
 long TcpConnection::sendfile(int filefd, long *offset, long count) {
     assert(filefd > 0);
     loop_->assertInLoopThread();
-    return ::sendfile(connChannel_->fd(), filefd, offset, count);
+    long ret = ::sendfile(connChannel_->fd(), filefd, offset, count);
+    if(ret < 0 && errno == EAGAIN) {
+        socketWritable_ = false;
+    }
+    return ret;
+}
+
+void TcpConnection::handleReadET(Timestamp recvTime) {
+    // edge-triggered: 一直读到 EAGAIN，之后才会有新的可读事件
+    // 每次最多读 kMaxBytesPerEvent，余下的排到任务队列中，不让一个连接占住 loop
+    size_t total = 0;
+    ssize_t n = 0;
+    int savedErrno = 0;
+    while(total < kMaxBytesPerEvent) {
+        n = readInput(&savedErrno);
+        if(n > 0) {
+            total += n;
+        }
+        else if(n < 0 && savedErrno == EINTR) {
+            continue;
+        }
+        else {
+            break;
+        }
+    }
+    if(total > 0) {
+        inputChanged();
+        msgCallback_(shared_from_this(), &input_, recvTime);
+    }
+    if(n > 0) {
+        // 没有读到 EAGAIN，不会再有新的可读事件
+        TcpConnectionPtr conn(shared_from_this());
+        loop_->queueInLoop([conn] {
+            if(conn->reading_ && (conn->state_ == StateE::kConnected
+                                  || conn->state_ == StateE::kDisconnecting)) {
+                conn->handleReadET(conn->loop_->pollReturnTime());
+            }
+        });
+    }
+    else if(n == 0) {
+        if(state_ == StateE::kConnected || state_ == StateE::kDisconnecting) {
+            handleClose();
+        }
+    }
+    else if(savedErrno != EAGAIN && savedErrno != EWOULDBLOCK) {
+        errno = savedErrno;
+        log_error("TcpConnection::handleReadET");
+        handleError();
+    }
+}
+
+void TcpConnection::flushOutputET() {
+    // edge-triggered: 一直写到 output_ 为空或 EAGAIN，EAGAIN 后等待下一次可写事件
+    // 与读相同，每次最多写 kMaxBytesPerEvent
+    bool hadData = outputBytes() > 0;
+    size_t total = 0;
+    while(outputBytes() > 0 && total < kMaxBytesPerEvent) {
+        ssize_t n = writeOutput();
+        if(n > 0) {
+            total += n;
+            continue;
+        }
+        else if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        else {
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                socketWritable_ = false;
+            }
+            else {
+                log_error("TcpConnection::flushOutputET");
+            }
+            break;
+        }
+    }
+    outputChanged();
+    if(outputBytes() > 0 && socketWritable_) {
+        TcpConnectionPtr conn(shared_from_this());
+        loop_->queueInLoop([conn] {
+            if(conn->socketWritable_ && (conn->state_ == StateE::kConnected
+                                         || conn->state_ == StateE::kDisconnecting)) {
+                conn->flushOutputET();
+            }
+        });
+    }
+    if(outputBytes() == 0 && (hadData || writeCompletePending_) && socketWritable_) {
+        writeCompletePending_ = false;
+        queueWriteComplete();
+        if(state_ == StateE::kDisconnecting) {
+            shutdownInLoop();
+        }
+    }
+}
+
+
+const size_t TcpConnection::kMaxRecvSize;
+const size_t TcpConnection::kMaxBytesPerEvent;
+const size_t TcpConnection::kMinZeroCopySize;
+
+void TcpConnection::startRecv() {
+    assert(uring_ != nullptr && recvOp_ == 0);
+    if(input_.writableBytes() < recvSize_) {
+        input_.makeSpace(recvSize_);
+    }
+    TcpConnectionPtr conn(shared_from_this());
+    // 直接 recv 到 input_ 的可写区域，completion 前不会有其他代码改动 input_
+    recvOp_ = uring_->submitRecv(sockFd_, input_.beginWrite(), input_.writableBytes(),
+        [conn] (int res, Timestamp recvTime) {
+            conn->handleRecvComplete(res, recvTime);
+        });
+}
+
+void TcpConnection::handleRecvComplete(int res, Timestamp recvTime) {
+    loop_->assertInLoopThread();
+    recvOp_ = 0;
+    if(state_ == StateE::kDisconnected || res == -ECANCELED) {
+        return;
+    }
+    if(res > 0) {
+        // 一次收满说明还有数据，与 readFd 的 64k extrabuf 上限一致
+        if(static_cast<size_t>(res) == input_.writableBytes() && recvSize_ < kMaxRecvSize) {
+            recvSize_ *= 2;
+        }
+        input_.hasWritten(res);
+        inputChanged();
+        msgCallback_(shared_from_this(), &input_, recvTime);
+        if(state_ != StateE::kDisconnected && recvOp_ == 0 && reading_) {
+            startRecv();
+        }
+    }
+    else if(res == 0) {
+        handleClose();
+    }
+    else if(res == -EAGAIN || res == -EINTR) {
+        if(reading_) {
+            startRecv();
+        }
+    }
+    else {
+        errno = -res;
+        log_error("TcpConnection::handleRecvComplete");
+        handleError();
+        handleClose();
+    }
+}
+
+void TcpConnection::startSend() {
+    assert(uring_ != nullptr && sendOp_ == 0);
+    // sending_ 在 send 完成前保持不变，新数据继续追加到 output_
+    if(sending_.readableBytes() == 0) {
+        sending_.swap(output_);
+    }
+    TcpConnectionPtr conn(shared_from_this());
+    auto callback = [conn] (int res, Timestamp) {
+        conn->handleSendComplete(res);
+    };
+    if(sending_.readableBytes() > 0) {
+        sendOp_ = uring_->submitSend(sockFd_, sending_.beginRead(),
+                                     sending_.readableBytes(), std::move(callback));
+    }
+    else {
+        // 空消息只用于等待可写后触发 writeCompleteCallback，与 readiness 模式一致
+        sendOp_ = uring_->submitPoll(sockFd_, POLLOUT, std::move(callback));
+    }
+}
+
+void TcpConnection::handleSendComplete(int res) {
+    loop_->assertInLoopThread();
+    sendOp_ = 0;
+    if(state_ == StateE::kDisconnected || res == -ECANCELED) {
+        return;
+    }
+    if(res < 0 && res != -EAGAIN && res != -EINTR) {
+        errno = -res;
+        log_error("TcpConnection::handleSendComplete");
+        // EPIPE / ECONNRESET 等: 对端已不可写，丢弃待发送的数据并关闭连接，
+        // 否则 sending_ 一直非空，后续的 send 永远不会再提交
+        sending_.retrieveAll();
+        output_.retrieveAll();
+        handleError();
+        handleClose();
+        return;
+    }
+    if(res > 0 && sending_.readableBytes() > 0) {
+        sending_.retrieve(res);
+        outputChanged();
+    }
+    if(sending_.readableBytes() > 0 || output_.readableBytes() > 0) {
+        log_trace("More data to write");
+        startSend();
+        return;
+    }
+    queueWriteComplete();
+    if(state_ == StateE::kDisconnecting) {
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::sendv(std::vector<Slice>&& slices) {
+    if(loop_->isInLoopThread()) {
+        sendvInLoop(slices);
+    }
+    else {
+        loop_->queueInLoop(
+            [this, slices = std::move(slices)] () mutable { sendvInLoop(slices); }
+        );
+    }
+}
+
+void TcpConnection::sendvInLoop(std::vector<Slice>& slices) {
+    loop_->assertInLoopThread();
+    if(state_ != StateE::kConnected) {
+        return;
+    }
+    if(uring_) {
+        for(const Slice& slice: slices) {
+            output_.append(slice.data(), slice.size());
+        }
+        if(sendOp_ == 0) {
+            startSend();
+        }
+        outputChanged();
+        return;
+    }
+    size_t total = 0;
+    for(Slice& slice: slices) {
+        if(slice.size() > 0) {
+            total += slice.size();
+            slices_.push_back(std::move(slice));
+        }
+    }
+    slicesBytes_ += total;
+    if(total == 0) {
+        sendInLoop(std::string()); // 与 send("") 一致，等待可写后回调 writeComplete
+        return;
+    }
+    flushSlices();
+}
+
+void TcpConnection::send(const PayloadPtr& payload) {
+    if(loop_->isInLoopThread()) {
+        sendPayloadInLoop(payload);
+    }
+    else {
+        loop_->queueInLoop(
+            [this, payload] { sendPayloadInLoop(payload); }
+        );
+    }
+}
+
+void TcpConnection::sendPayloadInLoop(const PayloadPtr& payload) {
+    loop_->assertInLoopThread();
+    if(state_ != StateE::kConnected) {
+        return;
+    }
+    if(uring_) {
+        output_.append(payload->data(), payload->size());
+        if(sendOp_ == 0) {
+            startSend();
+        }
+        outputChanged();
+        return;
+    }
+    if(payload->empty()) {
+        sendInLoop(std::string());
+        return;
+    }
+    // 只保存引用，未写出的部分由 writeOutput() 直接从 payload 发送
+    slices_.emplace_back(payload);
+    slicesBytes_ += payload->size();
+    flushSlices();
+}
+
+void TcpConnection::flushSlices() {
+    if(edgeTriggered_) {
+        if(socketWritable_) {
+            flushOutputET();
+        }
+    }
+    else if(!connChannel_->isWriting()) {
+        // 没有等待可写事件时先直接写，一次写完则不需要关注可写事件
+        ssize_t n = writeOutput();
+        if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            log_error("TcpConnection::flushSlices");
+        }
+        if(outputBytes() == 0) {
+            queueWriteComplete();
+        }
+        else {
+            connChannel_->enableWriting(true);
+        }
+    }
+    outputChanged();
+}
+
+ssize_t TcpConnection::writeOutput() {
+    if(zeroCopyThreshold_ > 0 && output_.readableBytes() == 0
+       && !slices_.empty() && slices_.front().size() >= zeroCopyThreshold_) {
+        ssize_t n = sendZeroCopy();
+        // ENOBUFS: 超出 optmem 限制，本次退回拷贝发送
+        if(n >= 0 || errno != ENOBUFS) {
+            return n;
+        }
+    }
+    struct iovec vec[kMaxIov];
+    int count = 0;
+    if(output_.readableBytes() > 0) {
+        vec[count].iov_base = const_cast<char*>(output_.beginRead());
+        vec[count].iov_len = output_.readableBytes();
+        count++;
+    }
+    for(auto it = slices_.begin(); it != slices_.end() && count < kMaxIov; ++it) {
+        vec[count].iov_base = const_cast<char*>(it->data());
+        vec[count].iov_len = it->size();
+        count++;
+    }
+    const ssize_t n = ::writev(connChannel_->fd(), vec, count);
+    if(n <= 0) {
+        return n;
+    }
+    size_t fromOutput = std::min(static_cast<size_t>(n), output_.readableBytes());
+    output_.retrieve(fromOutput);
+    consumeSlices(n - fromOutput);
+    return n;
+}
+
+void TcpConnection::consumeSlices(size_t n) {
+    slicesBytes_ -= n;
+    while(n > 0) {
+        Slice& front = slices_.front();
+        size_t used = std::min(n, front.size());
+        front.consume(used);
+        n -= used;
+        if(front.size() == 0) {
+            popFrontSlice();
+        }
+    }
+}
+
+void TcpConnection::queueWriteComplete() {
+    if(zcAcked_ != zcNextSeq_) {
+        // 写出的片段仍被未完成的 zerocopy 发送引用 (借用的片段此时还不能释放)，
+        // 推迟到 ackZeroCopy() 收到全部完成通知
+        zcWriteCompletePending_ = true;
+        return;
+    }
+    if(writeCompleteCallback_) {
+        loop_->queueInLoop(
+            std::bind(writeCompleteCallback_, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::popFrontSlice() {
+    if(zcAcked_ != zcNextSeq_) {
+        // 片段的数据不随 Slice 移动 (不小于阈值的 std::string 不使用 SSO)
+        zcPending_.emplace_back(zcNextSeq_ - 1, std::move(slices_.front()));
+    }
+    slices_.pop_front();
+}
+
+void TcpConnection::outputChanged() {
+    const size_t pending = outputBytes() + sending_.readableBytes();
+    if(pending != reportedPendingBytes_) {
+        loop_->addPendingBytes(static_cast<int64_t>(pending)
+                               - static_cast<int64_t>(reportedPendingBytes_));
+        reportedPendingBytes_ = pending;
+        checkWaterMarks(pending);
+    }
+    updateBufferBytes();
+    noteActivity();
+}
+
+void TcpConnection::checkWaterMarks(size_t pending) {
+    if(!aboveHighWater_ && pending >= highWaterMark_) {
+        aboveHighWater_ = true;
+        if(highWaterMarkCallback_) {
+            loop_->queueInLoop(
+                std::bind(highWaterMarkCallback_, shared_from_this(), pending)
+            );
+        }
+        if(pauseReadOnHighWater_) {
+            readPausedByWater_ = true;
+            updateReading();
+        }
+    }
+    else if(aboveHighWater_ && pending <= (lowWaterMark_ > 0 ? lowWaterMark_ : highWaterMark_ / 2)) {
+        aboveHighWater_ = false;
+        if(lowWaterMarkCallback_) {
+            loop_->queueInLoop(
+                std::bind(lowWaterMarkCallback_, shared_from_this())
+            );
+        }
+        if(readPausedByWater_) {
+            readPausedByWater_ = false;
+            updateReading();
+        }
+    }
+}
+
+void TcpConnection::stopRead() {
+    loop_->runInLoop([this] {
+        readPausedByUser_ = true;
+        updateReading();
+    });
+}
+
+void TcpConnection::startRead() {
+    loop_->runInLoop([this] {
+        readPausedByUser_ = false;
+        updateReading();
+    });
+}
+
+void TcpConnection::updateReading() {
+    loop_->assertInLoopThread();
+    if(state_ != StateE::kConnected && state_ != StateE::kDisconnecting) {
+        return;
+    }
+    const bool reading = !readPaused();
+    if(reading == reading_) {
+        return;
+    }
+    reading_ = reading;
+    if(uring_) {
+        // 已提交的 recv 完成后不再提交新的，恢复时补交
+        if(reading && recvOp_ == 0) {
+            startRecv();
+        }
+    }
+    else {
+        // edge-triggered 下重新关注可读事件时，内核会对已有的数据再次通知
+        connChannel_->enableReading(reading);
+    }
+    log_trace("TcpConnection [%s] %s reading", name_.c_str(), reading ? "resumes" : "pauses");
+}
+
+void TcpConnection::inputChanged() {
+    inputPeak_ = std::max(inputPeak_, input_.readableBytes());
+    updateBufferBytes();
+    noteActivity();
+}
+
+size_t TcpConnection::bufferBytes() const {
+    return input_.capacity() + output_.capacity() + sending_.capacity();
+}
+
+void TcpConnection::updateBufferBytes() {
+    const size_t bytes = bufferBytes();
+    if(bytes != reportedBufferBytes_) {
+        loop_->addBufferBytes(static_cast<int64_t>(bytes)
+                              - static_cast<int64_t>(reportedBufferBytes_));
+        reportedBufferBytes_ = bytes;
+    }
+}
+
+void TcpConnection::noteActivity() {
+    ioCount_++;
+    lastActive_ = loop_->monotonicTime();
+    if(bufferIdleTimeout_ > 0 && !idleTimer_.pending() && state_ == StateE::kConnected) {
+        armIdleTimer();
+    }
+}
+
+void TcpConnection::armIdleTimer() {
+    // 时间轮定时器，每个连接一个，刷新不分配内存；连接关闭时取消
+    idleCheckCount_ = ioCount_;
+    loop_->addWheelTimer(&idleTimer_, bufferIdleTimeout_);
+}
+
+void TcpConnection::checkIdle() {
+    loop_->assertInLoopThread();
+    if(state_ != StateE::kConnected) {
+        return;
+    }
+    if(idleCheckCount_ != ioCount_) {
+        // 上个周期内有读写，重新计时
+        armIdleTimer();
+        return;
+    }
+    // 空闲: 回收后不再计时，下次读写时重新开始
+    reclaimBuffers();
 }
 
+void TcpConnection::reclaimBuffers() {
+    if(inputPeak_ > 0) {
+        loop_->observeBufferPeak(inputPeak_);
+        inputPeak_ = 0;
+    }
+    // completion 模式下 input_ 的可写区域正被 recv 使用
+    if(recvOp_ == 0 && input_.capacity() > input_.readableBytes() + Buffer::kCheapPrepend) {
+        input_.shrink(0);
+    }
+    if(output_.capacity() > output_.readableBytes() + Buffer::kCheapPrepend) {
+        output_.shrink(0);
+    }
+    // 正在由 io_uring 发送时 sending_ 不可改动
+    if(sendOp_ == 0 && sending_.readableBytes() == 0 && sending_.capacity() > Buffer::kCheapPrepend) {
+        sending_.shrink(0);
+    }
+    recvSize_ = Buffer::kInitialSize;
+    updateBufferBytes();
+    log_trace("TcpConnection [%s] idle, buffers shrink to %zu bytes", name_.c_str(), bufferBytes());
+}
+
+void TcpConnection::armTimeoutTimer(double delay) {
+    loop_->addWheelTimer(&timeoutTimer_, delay);
+}
+
+void TcpConnection::checkIdleTimeout() {
+    loop_->assertInLoopThread();
+    if(state_ != StateE::kConnected && state_ != StateE::kDisconnecting) {
+        return;
+    }
+    const Timestamp deadline = lastActive_ + static_cast<Timestamp>(idleTimeout_ * 1000000);
+    const Timestamp now = loop_->monotonicTime();
+    if(now < deadline) {
+        // 计时期间有读写，按最近一次读写重新计时
+        armTimeoutTimer(static_cast<double>(deadline - now) / 1000000);
+        return;
+    }
+    log_info("TcpConnection [%s] idle for %.1fs, closing", name_.c_str(),
+             static_cast<double>(now - lastActive_) / 1000000);
+    handleClose();
+}
+
+void TcpConnection::cancelOps() {
+    if(uring_ == nullptr) {
+        return;
+    }
+    if(recvOp_ != 0) {
+        uring_->cancelOp(recvOp_);
+        recvOp_ = 0;
+    }
+    if(sendOp_ != 0) {
+        uring_->cancelOp(sendOp_);
+        sendOp_ = 0;
+    }
+}
+
+ssize_t TcpConnection::sendZeroCopy() {
+    struct iovec vec[kMaxIov];
+    int count = 0;
+    for(auto it = slices_.begin(); it != slices_.end() && count < kMaxIov; ++it) {
+        if(it->size() < zeroCopyThreshold_) {
+            break;
+        }
+        vec[count].iov_base = const_cast<char*>(it->data());
+        vec[count].iov_len = it->size();
+        count++;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = count;
+    const ssize_t n = ::sendmsg(connChannel_->fd(), &msg, MSG_ZEROCOPY);
+    if(n <= 0) {
+        return n;
+    }
+    // 每次成功的发送占用一个序号，内核按序号范围通知完成
+    zcNextSeq_++;
+    consumeSlices(n);
+    return n;
+}
+
+void TcpConnection::handleErrorEvent() {
+    if(zeroCopyThreshold_ > 0 && reapZeroCopy()) {
+        return;
+    }
+    errno = socket::getSocketError(sockFd_);
+    log_error("TcpConnection::handleErrorEvent [%s]", name_.c_str());
+    handleError();
+}
+
+bool TcpConnection::reapZeroCopy() {
+    bool reaped = false;
+    while(true) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(::recvmsg(sockFd_, &msg, MSG_ERRQUEUE) < 0) {
+            break; // EAGAIN: 错误队列已空
+        }
+        for(struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+            // AF_INET6 socket (包括 v4-mapped 地址) 的通知以 SOL_IPV6 / IPV6_RECVERR 返回
+            if(!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+               && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            const struct sock_extended_err* err =
+                reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+            if(err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            if(err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                // 例如 loopback: 内核仍然拷贝了数据，只是多了通知的开销
+                log_trace("TcpConnection [%s] zerocopy send was copied", name_.c_str());
+            }
+            ackZeroCopy(err->ee_info, err->ee_data);
+            reaped = true;
+        }
+    }
+    return reaped;
+}
+
+void TcpConnection::ackZeroCopy(uint32_t lo, uint32_t hi) {
+    if(lo != zcAcked_) {
+        zcAckedRanges_[lo] = hi;
+        return;
+    }
+    zcAcked_ = hi + 1;
+    for(auto it = zcAckedRanges_.find(zcAcked_); it != zcAckedRanges_.end();
+        it = zcAckedRanges_.find(zcAcked_)) {
+        zcAcked_ = it->second + 1;
+        zcAckedRanges_.erase(it);
+    }
+    // 序号回绕时按差值比较
+    while(!zcPending_.empty()
+          && static_cast<int32_t>(zcPending_.front().first - zcAcked_) < 0) {
+        zcPending_.pop_front();
+    }
+    if(zcWriteCompletePending_ && zcAcked_ == zcNextSeq_) {
+        zcWriteCompletePending_ = false;
+        // 期间又有新的输出时由它写完后回调
+        if(outputBytes() == 0) {
+            queueWriteComplete();
+        }
+    }
+}
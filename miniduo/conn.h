@@ -5,9 +5,16 @@
 #include "net.h"
 #include "buffer.h"
 #include "util.h" // AutoContext
+#include "poller.h" // IoUringPoller
+#include "timer.h" // WheelTimer
+#include "slice.h"
 
+#include <atomic>
+#include <cassert>
+#include <deque>
 #include <functional>
 #include <map>
+#include <vector>
 
 namespace miniduo
 {
@@ -24,7 +31,8 @@ class Acceptor {
 public:
     typedef std::function<void (int sockfd, const SockAddr&)> NewConnectionCallback;
     
-    Acceptor(EventLoop* loop, const SockAddr& listenAddr);
+    /// @param reusePort 设置 SO_REUSEPORT，允许多个 Acceptor 绑定同一地址
+    Acceptor(EventLoop* loop, const SockAddr& listenAddr, bool reusePort = false);
     ~Acceptor() {
         if(acceptFd_ > 0) {
             socket::close(acceptFd_);
@@ -37,6 +45,8 @@ public:
     bool listenning() const { return listening_; }
     /// @brief 执行创建TCP服务步骤，调用socket, bind, listen, 出错即终止
     void listen();
+    /// @brief 从 poller 中移除监听 channel，不再接受连接; 在 loop 线程中调用
+    void stop();
 
 private:
     void handleRead(Timestamp recvTime);
@@ -54,6 +64,8 @@ class TcpServer {
     TcpServer& operator=(const TcpServer&) = delete;
 public:
     TcpServer(EventLoop* loop, const SockAddr& listenAddr);
+    /// 在 loop 线程中析构; reusePort 模式下在各 IO loop 中停止 acceptor 并销毁连接，
+    /// 等待完成后返回，此时 IO loop 需仍在运行
     ~TcpServer();
 
     void start();
@@ -67,22 +79,102 @@ public:
     void setWriteCompleteCallback(const WriteCompleteCallback& cb) {
         writeCompleteCallback_ = cb;
     }
+    /// @brief 新连接的高/低水位，见 TcpConnection::setHighWaterMarkCallback()
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark) {
+        highWaterMarkCallback_ = cb;
+        highWaterMark_ = highWaterMark;
+    }
+    void setLowWaterMarkCallback(const LowWaterMarkCallback& cb, size_t lowWaterMark) {
+        lowWaterMarkCallback_ = cb;
+        lowWaterMark_ = lowWaterMark;
+    }
+    /// @brief 新连接超过高水位时暂停读取，见 TcpConnection::setPauseReadOnHighWater()
+    void setPauseReadOnHighWater(bool enable) {
+        pauseReadOnHighWater_ = enable;
+    }
+    /// @brief 新连接使用 io_uring completion 模式收发数据，
+    /// 所属 loop 不是 io_uring poller 时退回 readiness 模式
+    void setCompletionMode(bool enable) {
+        completionMode_ = enable;
+    }
+    /// @brief 新连接使用 edge-triggered 模式，poller 不支持时保持 level-triggered
+    void setEdgeTriggered(bool enable) {
+        edgeTriggered_ = enable;
+    }
+    /// @brief 新连接设置 SO_BUSY_POLL，0 (默认) 不设置
+    /// 与 EventLoop::setSpinBudget() 配合降低延迟
+    void setBusyPoll(int usec) {
+        busyPollUs_ = usec;
+    }
+    /// @brief 每个 IO loop (loop->ioLoops()) 各持有一个 SO_REUSEPORT 的 Acceptor，
+    /// 新连接由内核分发，在接受它的 loop 中建立和服务，不经过主 loop 转交
+    /// 在 start() 之前调用
+    void setReusePort(bool enable) {
+        assert(!started_);
+        reusePort_ = enable;
+    }
+    /// @brief 新连接不小于 bytes 的待发送片段使用 MSG_ZEROCOPY 发送，0 (默认) 关闭
+    /// 见 TcpConnection::setZeroCopyThreshold()
+    void setZeroCopyThreshold(size_t bytes) {
+        zeroCopyThreshold_ = bytes;
+    }
+    /// @brief 新连接空闲 seconds 秒后释放缓冲区内存，0 (默认) 关闭
+    /// 见 TcpConnection::setBufferIdleTimeout()
+    void setBufferIdleTimeout(double seconds) {
+        bufferIdleTimeout_ = seconds;
+    }
+    /// @brief 新连接连续 seconds 秒没有读写时关闭，0 (默认) 关闭
+    /// 见 TcpConnection::setIdleTimeout()
+    void setIdleTimeout(double seconds) {
+        idleTimeout_ = seconds;
+    }
+    /// @brief thread safe, 所用 IO loop 上所有连接的缓冲区内存，
+    /// 与其他 TcpServer 共用 loop 时包含其连接
+    int64_t bufferBytes() const;
+    /// @brief 新连接直接读入 input buffer，见 TcpConnection::setDirectRead()
+    void setDirectRead(bool enable) {
+        directRead_ = enable;
+    }
 
 private:
-    void newConnection(int sockfd, const SockAddr& peerAddr);
-    void removeConnection(const TcpConnectionPtr& conn);
-    void removeConnectionInLoop(const TcpConnectionPtr& conn);
     typedef std::map<std::string, TcpConnectionPtr> ConnectionMap;
+    // 一个 Acceptor 及其接受的连接，只在 loop 线程中访问
+    struct Listener {
+        EventLoop* loop;
+        std::unique_ptr<Acceptor> acceptor;
+        ConnectionMap connections;
+    };
+
+    void newConnection(Listener* listener, int sockfd, const SockAddr& peerAddr);
+    void removeConnection(Listener* listener, const TcpConnectionPtr& conn);
+    void removeConnectionInLoop(Listener* listener, const TcpConnectionPtr& conn);
+    void addListener(EventLoop* loop);
+    // 在 listener->loop 中: 停止 acceptor，销毁它接受的连接
+    void closeListener(Listener* listener);
 
     EventLoop* loop_;   // The acceptor loop;
     const std::string name_;
-    std::unique_ptr<Acceptor> acceptor_;
+    const SockAddr listenAddr_;
+    // 默认模式下只有 loop_ 上的一个，reusePort 模式下每个 IO loop 一个
+    std::vector<std::unique_ptr<Listener>> listeners_;
     ConnectionCallback connectionCallback_;
     MsgCallback msgCallback_;
     WriteCompleteCallback writeCompleteCallback_;
+    HighWaterMarkCallback highWaterMarkCallback_;
+    LowWaterMarkCallback lowWaterMarkCallback_;
+    size_t highWaterMark_;
+    size_t lowWaterMark_;
+    bool pauseReadOnHighWater_;
     bool started_;
-    int nextConnId_;
-    ConnectionMap connections_;
+    bool completionMode_;
+    bool edgeTriggered_;
+    int busyPollUs_;
+    bool reusePort_;
+    size_t zeroCopyThreshold_;
+    double bufferIdleTimeout_;
+    double idleTimeout_;
+    bool directRead_;
+    std::atomic<int> nextConnId_; // reusePort 模式下多个 loop 并发分配
 
 }; // class TcpServer
 
@@ -121,13 +213,74 @@ public:
     void setWriteCompleteCallback(const WriteCompleteCallback& cb) {
         writeCompleteCallback_ = cb;
     }
+    /// @brief 待发送的字节数 (output buffer、排队的片段及 io_uring 正在发送的数据)
+    /// 从低于升到不低于 highWaterMark 时回调，默认 64 MiB
+    void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark) {
+        highWaterMarkCallback_ = cb;
+        highWaterMark_ = highWaterMark;
+    }
+    /// @brief 超过高水位后待发送的字节数降到不高于 lowWaterMark 时回调，
+    /// 0 (默认) 表示高水位的一半
+    void setLowWaterMarkCallback(const LowWaterMarkCallback& cb, size_t lowWaterMark) {
+        lowWaterMarkCallback_ = cb;
+        lowWaterMark_ = lowWaterMark;
+    }
+    /// @brief 超过高水位时停止读取，降到低水位后恢复，慢速读取的对端因此无法让输出无限增长
+    void setPauseReadOnHighWater(bool enable) {
+        pauseReadOnHighWater_ = enable;
+    }
+    // Thread safe, 暂停/恢复读取，例如 proxy 在转发的目标连接超过高水位时暂停来源连接
+    // 与高水位的自动暂停相互独立，两者都未暂停时才读取
+    void stopRead();
+    void startRead();
+    /// @brief 在 connectEstablished() 前调用；使用 io_uring 提交 recv/send，
+    /// 所属 loop 不支持时保持 readiness 模式
+    void setCompletionMode(bool enable);
+    bool completionMode() const { return uring_ != nullptr; }
+    /// @brief 在 connectEstablished() 前调用；edge-triggered 模式下读写都循环到 EAGAIN
+    /// (每次事件最多 kMaxBytesPerEvent，余下的在 loop 的任务队列中继续)，
+    /// 始终关注可写事件，发送时不再切换 enableWriting()
+    void setEdgeTriggered(bool enable);
+    bool edgeTriggered() const { return edgeTriggered_; }
+    /// @brief 在 connectEstablished() 前调用；readiness 模式下用 Buffer::readFdDirect() 读取，
+    /// 预留的可写空间从初始大小开始，读满时加倍 (上限 kMaxRecvSize)，大消息不再经过 extrabuf 拷贝
+    void setDirectRead(bool enable);
+    /// @brief 在 connectEstablished() 前调用；连续 seconds 秒以上没有读写时
+    /// 释放 input/output buffer 中空闲的内存 (保留未处理的数据)，0 (默认) 关闭
+    void setBufferIdleTimeout(double seconds);
+    // input/output buffer 占用的内存
+    size_t bufferBytes() const;
+    /// @brief 在 connectEstablished() 前调用；连续 seconds 秒以上没有读写时关闭连接
+    /// (包括已 shutdown() 等待对端关闭的连接)，0 (默认) 关闭
+    /// 读写时只记下 EventLoop::monotonicTime()，不操作定时器；每个连接一个时间轮定时器，
+    /// 到期时期间有过读写则按剩余时间重新加入，同一 tick 到期的连接在一次推进中一并处理
+    void setIdleTimeout(double seconds);
+    double idleTimeout() const { return idleTimeout_; }
+    // 最近一次读写的时间 (EventLoop::monotonicTime())
+    Timestamp lastActiveTime() const { return lastActive_; }
+    /// @brief 在 connectEstablished() 前调用；output buffer 为空时，
+    /// 不小于 bytes 的片段 (sendv / send(PayloadPtr)) 以 sendmsg(MSG_ZEROCOPY) 发送，
+    /// 片段在内核从 socket 错误队列通知完成后才释放，writeCompleteCallback 也推迟到全部完成之后;
+    /// 析构时仍有未完成的发送则以 RST 关闭。0 关闭，小于 kMinZeroCopySize 时按其计算
+    /// completion 模式或 socket 不支持 SO_ZEROCOPY 时保持关闭
+    void setZeroCopyThreshold(size_t bytes);
+    size_t zeroCopyThreshold() const { return zeroCopyThreshold_; }
 
     void connectEstablished();
     void connectDestroyed();
     // Thread safe
     void shutdown();
-    // Thread safe
+    // Thread safe, 跨线程时拷贝 msg
     void send(const std::string& msg);
+    // Thread safe, 跨线程时 msg 被移动进任务，不再拷贝
+    void send(std::string&& msg);
+    /// @brief Thread safe, 依次发送多个片段，排在已有的输出之后，
+    /// 用一次 writev(2) 写出，不先拷贝到 output buffer
+    /// completion 模式下片段被拷贝到 output buffer 后发送
+    void sendv(std::vector<Slice>&& slices);
+    /// @brief Thread safe, 跨线程时只拷贝引用；连接持有 payload 直到内核取走全部数据，
+    /// 多个连接共享同一份数据。completion 模式下 payload 被拷贝到 output buffer 后发送
+    void send(const PayloadPtr& payload);
     // Thread safe
     void close();
     // Thread safe;
@@ -138,6 +291,11 @@ public:
 
 private:
     enum class StateE { kConnecting, kConnected, kDisconnecting, kDisconnected, };
+    static const size_t kMaxRecvSize = 65536;
+    // edge-triggered 下一次事件最多读 (写) 的字节数，用完后排到任务队列中继续
+    static const size_t kMaxBytesPerEvent = 256 * 1024;
+    // 更小的发送固定页面和取回通知的开销超过拷贝
+    static const size_t kMinZeroCopySize = 16 * 1024;
 
     void setState(StateE s) {
         state_ = s;
@@ -145,10 +303,63 @@ private:
     void shutdownInLoop();
     void closeInLoop();
     void sendInLoop(const std::string& msg);
+    void sendvInLoop(std::vector<Slice>& slices);
+    void sendPayloadInLoop(const PayloadPtr& payload);
+    // 新片段加入 slices_ 后尝试写出，未写完时等待可写事件
+    void flushSlices();
+    // output_ 与 slices_ 中尚未写入 socket 的字节数
+    size_t outputBytes() const { return output_.readableBytes() + slicesBytes_; }
+    /// @brief 以一次 writev(2) 写出 output_ 及其后的 slices_，并取出已写的部分
+    /// @return writev 的返回值
+    ssize_t writeOutput();
+    // 从 slices_ 取出已写出的 n 字节
+    void consumeSlices(size_t n);
+    // 移除已写完的首个片段，仍可能被未完成的 zerocopy 发送引用时移入 zcPending_
+    void popFrontSlice();
+    // 按 directRead_ 选择 readFd 或 readFdDirect
+    ssize_t readInput(int* savedErrno);
     void handleRead(Timestamp recvTime);
     void handleWrite();
     void handleClose();
     void handleError();
+    // edge-triggered 模式
+    void handleReadET(Timestamp recvTime);
+    void flushOutputET();
+    // completion 模式
+    void startRecv();
+    void startSend();
+    void handleRecvComplete(int res, Timestamp recvTime);
+    void handleSendComplete(int res);
+    void cancelOps();
+    // zerocopy 模式
+    // 以一次 sendmsg(MSG_ZEROCOPY) 写出 slices_ 开头不小于阈值的片段
+    ssize_t sendZeroCopy();
+    // POLLERR: 先取回 zerocopy 完成通知，没有通知时按 socket 错误处理
+    void handleErrorEvent();
+    // 读空 socket 错误队列，释放内核已完成发送的片段，返回是否取到通知
+    bool reapZeroCopy();
+    void ackZeroCopy(uint32_t lo, uint32_t hi);
+    // 输出已全部写入 socket: 回调 writeCompleteCallback_，有未完成的 zerocopy 发送时推迟
+    void queueWriteComplete();
+    // 输出变化后: 将待发送字节数的变化计入 loop_->pendingBytes()，检查高低水位，
+    // 更新内存计数，记一次活动
+    void outputChanged();
+    void checkWaterMarks(size_t pending);
+    // readPausedByUser_ 或 readPausedByWater_ 变化后启用/停止读取
+    void updateReading();
+    bool readPaused() const { return readPausedByUser_ || readPausedByWater_; }
+    // 读到数据后: 记录 input buffer 峰值，更新内存计数，记一次活动
+    void inputChanged();
+    void updateBufferBytes();
+    // 每次读写: 计数并记录时间，供空闲回收和空闲超时使用
+    // 空闲回收: 定时器到期时计数不变则释放缓冲区内存
+    void noteActivity();
+    void armIdleTimer();
+    void checkIdle();
+    void reclaimBuffers();
+    // 空闲超时: 定时器到期时按 lastActive_ 判断是否关闭
+    void armTimeoutTimer(double delay);
+    void checkIdleTimeout();
 
     EventLoop* loop_;
     std::string name_;
@@ -164,7 +375,50 @@ private:
     MsgCallback msgCallback_;               // 用户回调
     CloseCallback closeCallback_;           // 绑定 TcpSever::removeConnection()
     WriteCompleteCallback writeCompleteCallback_; // 用户回调
+    HighWaterMarkCallback highWaterMarkCallback_; // 用户回调
+    LowWaterMarkCallback lowWaterMarkCallback_;   // 用户回调
+    size_t highWaterMark_;
+    size_t lowWaterMark_;
+    bool pauseReadOnHighWater_;
+    bool aboveHighWater_;     // 已回调高水位，尚未降到低水位
+    bool readPausedByUser_;   // stopRead()
+    bool readPausedByWater_;  // 超过高水位自动暂停
+    bool reading_;            // 当前是否在读取 (关注可读事件或提交 recv)
+    size_t reportedPendingBytes_; // 已计入 loop_ 的待发送字节数
+    size_t reportedBufferBytes_;  // 已计入 loop_ 的缓冲区内存
+    size_t inputPeak_;            // 上次回收以来 input buffer 的最大数据量
+    double bufferIdleTimeout_;
+    uint64_t ioCount_;
+    uint64_t idleCheckCount_; // 上次计时开始时的 ioCount_
+    WheelTimer idleTimer_;
+    double idleTimeout_;
+    Timestamp lastActive_;
+    WheelTimer timeoutTimer_;
+    std::deque<Slice> slices_; // 排在 output_ 之后发送的片段
+    size_t slicesBytes_;
+
+    bool directRead_;
+
+    // edge-triggered 模式
+    bool edgeTriggered_;
+    bool socketWritable_;      // 上次写没有遇到 EAGAIN
+    bool writeCompletePending_; // 空消息 send("") 等待可写后回调 writeComplete
+
+    // completion 模式, uring_ 为空时为 readiness 模式
+    IoUringPoller* uring_;
+    Buffer sending_;          // 正在由 io_uring 发送的数据，发送期间不可改动
+    IoUringPoller::OpId recvOp_; // 0 表示没有未完成的 recv
+    size_t recvSize_;            // 下一次 recv 请求的最小长度，收满时翻倍; directRead_ 时同样使用
+    IoUringPoller::OpId sendOp_; // 0 表示没有未完成的 send/poll
 
+    // zerocopy 模式, zeroCopyThreshold_ 为 0 时关闭
+    size_t zeroCopyThreshold_;
+    uint32_t zcNextSeq_; // 下一次 MSG_ZEROCOPY 发送的序号，与内核的计数一致
+    uint32_t zcAcked_;   // 序号小于它的发送都已完成
+    std::map<uint32_t, uint32_t> zcAckedRanges_; // 乱序到达的完成通知 [lo, hi]
+    // 等待完成通知的片段及可能引用它的最后一次发送的序号，序号不减
+    std::deque<std::pair<uint32_t, Slice>> zcPending_;
+    bool zcWriteCompletePending_; // 输出已写完，等待 zerocopy 完成通知后回调 writeComplete
 
 }; // class TcpConnection
 
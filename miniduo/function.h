@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef> // std::max_align_t
+#include <functional> // std::function<>
+#include <new> // placement new
+#include <type_traits>
+#include <utility> // std::forward, std::move
+
+namespace miniduo {
+
+template <class Signature, size_t Capacity = 64>
+class SmallFunction;
+
+/// 只可移动的函数对象，替代 std::function
+/// 大小不超过 Capacity 且可 nothrow 移动的可调用对象直接存放在内部缓冲区，不分配堆内存；
+/// 更大的对象退化为一次堆分配。不要求可调用对象可拷贝，因此可以捕获 unique_ptr 等
+template <class R, class... Args, size_t Capacity>
+class SmallFunction<R(Args...), Capacity> {
+public:
+    SmallFunction() noexcept : ops_(nullptr) {}
+    SmallFunction(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+    template <class F,
+              class = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type, SmallFunction>::value>::type>
+    SmallFunction(F&& f) : ops_(nullptr) {
+        typedef typename std::decay<F>::type Functor;
+        if(isNull(f)) {
+            return; // 空的函数指针或 std::function 得到空的 SmallFunction
+        }
+        construct<Functor>(std::forward<F>(f),
+                           std::integral_constant<bool, fitsInline<Functor>()>());
+    }
+
+    SmallFunction(SmallFunction&& rhs) noexcept : ops_(rhs.ops_) {
+        if(ops_) {
+            ops_->move(&storage_, &rhs.storage_);
+            rhs.ops_ = nullptr;
+        }
+    }
+
+    SmallFunction& operator=(SmallFunction&& rhs) noexcept {
+        if(this != &rhs) {
+            reset();
+            if(rhs.ops_) {
+                rhs.ops_->move(&storage_, &rhs.storage_);
+                ops_ = rhs.ops_;
+                rhs.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    SmallFunction& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    SmallFunction(const SmallFunction&) = delete;
+    SmallFunction& operator=(const SmallFunction&) = delete;
+
+    ~SmallFunction() { reset(); }
+
+    // 与 std::function 一致: const 调用，可调用对象按非 const 调用
+    R operator()(Args... args) const {
+        return ops_->invoke(&storage_, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+private:
+    struct Ops {
+        R (*invoke)(void* storage, Args&&... args);
+        void (*move)(void* dst, void* src); // 移动构造到 dst，并析构 src
+        void (*destroy)(void* storage);
+    };
+
+    template <class F>
+    static bool isNull(const F&) { return false; }
+    template <class T>
+    static bool isNull(T* f) { return f == nullptr; }
+    template <class Sig>
+    static bool isNull(const std::function<Sig>& f) { return !f; }
+
+    template <class Functor>
+    static constexpr bool fitsInline() {
+        return sizeof(Functor) <= Capacity
+            && alignof(Functor) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<Functor>::value;
+    }
+
+    // 内部缓冲区存放可调用对象
+    template <class Functor>
+    struct InlineOps {
+        static R invoke(void* storage, Args&&... args) {
+            return (*static_cast<Functor*>(storage))(std::forward<Args>(args)...);
+        }
+        static void move(void* dst, void* src) {
+            Functor* from = static_cast<Functor*>(src);
+            new (dst) Functor(std::move(*from));
+            from->~Functor();
+        }
+        static void destroy(void* storage) {
+            static_cast<Functor*>(storage)->~Functor();
+        }
+        static const Ops ops;
+    };
+
+    // 内部缓冲区只存放指向堆上可调用对象的指针
+    template <class Functor>
+    struct HeapOps {
+        static Functor*& ptr(void* storage) {
+            return *static_cast<Functor**>(storage);
+        }
+        static R invoke(void* storage, Args&&... args) {
+            return (*ptr(storage))(std::forward<Args>(args)...);
+        }
+        static void move(void* dst, void* src) {
+            new (dst) Functor*(ptr(src));
+        }
+        static void destroy(void* storage) {
+            delete ptr(storage);
+        }
+        static const Ops ops;
+    };
+
+    template <class Functor, class F>
+    void construct(F&& f, std::true_type /* inline */) {
+        new (&storage_) Functor(std::forward<F>(f));
+        ops_ = &InlineOps<Functor>::ops;
+    }
+
+    template <class Functor, class F>
+    void construct(F&& f, std::false_type /* heap */) {
+        new (&storage_) Functor*(new Functor(std::forward<F>(f)));
+        ops_ = &HeapOps<Functor>::ops;
+    }
+
+    void reset() noexcept {
+        if(ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    mutable typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type storage_;
+    const Ops* ops_;
+
+}; // class SmallFunction
+
+template <class R, class... Args, size_t Capacity>
+template <class Functor>
+const typename SmallFunction<R(Args...), Capacity>::Ops
+SmallFunction<R(Args...), Capacity>::InlineOps<Functor>::ops = {
+    &InlineOps<Functor>::invoke, &InlineOps<Functor>::move, &InlineOps<Functor>::destroy
+};
+
+template <class R, class... Args, size_t Capacity>
+template <class Functor>
+const typename SmallFunction<R(Args...), Capacity>::Ops
+SmallFunction<R(Args...), Capacity>::HeapOps<Functor>::ops = {
+    &HeapOps<Functor>::invoke, &HeapOps<Functor>::move, &HeapOps<Functor>::destroy
+};
+
+} // namespace miniduo
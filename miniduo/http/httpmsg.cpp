@@ -9,6 +9,9 @@
 #include <sstream>
 #include <fcntl.h> // open
 
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::HTTP
+
 namespace miniduo {
 
 std::unordered_map<int, std::pair<std::string, std::string>> HttpResponse::responseStatus
@@ -214,9 +217,13 @@ bool HttpResponse::headersAppend(const char *format, ...) {
     char buf[2048] = {0};
     va_list argList;
     va_start(argList, format);
-    vsnprintf(buf, sizeof(buf), format, argList);
+    int n = vsnprintf(buf, sizeof(buf), format, argList);
     va_end(argList);
-    return headersAppend(std::string(buf, sizeof(buf)));
+    if(n < 0) {
+        return false;
+    }
+    // 只追加格式化出的内容，不含 buf 中其余的 '\0'
+    return headersAppend(std::string(buf, std::min<size_t>(n, sizeof(buf) - 1)));
 }
 
 bool HttpResponse::addStatusLine(int status) {
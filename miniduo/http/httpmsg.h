@@ -16,7 +16,11 @@
 
 namespace miniduo {
 
-#define http_log(...) log_trace("[http] " __VA_ARGS__)
+#if MINIDUO_LOG_MIN_LEVEL <= 1
+#define http_log(...) log_module(Logger::LogModule::HTTP, Logger::LogLevel::TRACE, "[TRACE]", "[http] " __VA_ARGS__)
+#else
+#define http_log(...) _log_nothing(__VA_ARGS__)
+#endif
 
 
 
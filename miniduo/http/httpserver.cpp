@@ -9,6 +9,9 @@
 #include <sstream>
 #include <fcntl.h> // open
 
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::HTTP
+
 using namespace miniduo;
 
 namespace miniduo {
@@ -116,6 +119,10 @@ void HttpServer::onWriteComplete(const TcpConnectionPtr &conn) {
             http_log("%ld bytes data have been sent", ret);
             conn->send(""); // msg string is empty, it is used to enable writeable event
         }
+        else if(ret < 0 && errno == EAGAIN) {
+            // 发送缓冲区已满，等待可写后继续发送
+            conn->send("");
+        }
         else { // ret == 0 || ret == -1
             http_log("File sending completed");
             bool close = resp.closeConnection_;
@@ -244,8 +251,11 @@ void HttpServer::sendResponse(const TcpConnectionPtr &conn) {
     HttpResponse &resp = getHttpResponse(conn);
     HttpRequest &req = getHttpRequest(conn);
     http_log("HttpServer::sendReponse()");
-    conn->send(resp.headers_);
-    conn->send(resp.body_);
+    // headers 与 body 移入连接，由一次 writev 发出
+    std::vector<Slice> slices;
+    slices.emplace_back(std::move(resp.headers_));
+    slices.emplace_back(std::move(resp.body_));
+    conn->sendv(std::move(slices));
     // conn 在onWriteComplete() 中关闭 
     
 }
@@ -0,0 +1,187 @@
+#include "logarchiver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h> // opendir()
+#include <fcntl.h> // open()
+#include <stdio.h>
+#include <stdlib.h> // atol()
+#include <string.h> // strerror()
+#include <sys/stat.h> // stat()
+#include <unistd.h> // read() unlink()
+#include <utility>
+#include <vector>
+
+#ifdef MINIDUO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+const char kGzSuffix[] = ".gz";
+
+bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// 文件名为 "baseName.YYYYmmdd-HHMMSS", 同一秒内切换的文件再加 ".N"
+// 去掉 ".gz" 后按 (时间部分的字典序, N) 即为时间顺序
+std::pair<std::string, long> sortKey(std::string name) {
+    if(endsWith(name, kGzSuffix)) {
+        name.resize(name.size() - strlen(kGzSuffix));
+    }
+    size_t dot = name.rfind('.');
+    if(dot == std::string::npos || dot + 1 == name.size()
+       || name.find_first_not_of("0123456789", dot + 1) != std::string::npos) {
+        return std::make_pair(name, 0L);
+    }
+    return std::make_pair(name.substr(0, dot), atol(name.c_str() + dot + 1));
+}
+} // namespace
+
+bool LogArchiver::compressionSupported() {
+#ifdef MINIDUO_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+LogArchiver::LogArchiver()
+    : stop_(false),
+      thread_(&LogArchiver::run, this) {
+}
+
+LogArchiver::~LogArchiver() {
+    {
+        std::lock_guard<std::mutex> lock(mut_);
+        stop_ = true;
+        cv_.notify_one();
+    }
+    thread_.join();
+}
+
+void LogArchiver::add(Job job) {
+    std::lock_guard<std::mutex> lock(mut_);
+    jobs_.push_back(std::move(job));
+    cv_.notify_one();
+}
+
+void LogArchiver::run() {
+    std::unique_lock<std::mutex> lock(mut_);
+    while(true) {
+        cv_.wait(lock, [this] { return !jobs_.empty() || stop_; });
+        if(stop_) {
+            break;
+        }
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+        process(job);
+        lock.lock();
+    }
+}
+
+void LogArchiver::process(const Job& job) {
+    if(job.compress && compressionSupported()) {
+        compressFile(job.closed);
+    }
+    applyRetention(job);
+}
+
+bool LogArchiver::compressFile(const std::string& path) {
+#ifdef MINIDUO_HAVE_ZLIB
+    int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(in < 0) {
+        // ENOENT: 排队期间已被保留上限删除
+        if(errno != ENOENT) {
+            fprintf(stderr, "compress log %s failed: %s\n", path.c_str(), ::strerror(errno));
+        }
+        return false;
+    }
+    // 写到临时文件，完成后改名，目录中不会出现不完整的 .gz
+    const std::string gz = path + kGzSuffix;
+    const std::string tmp = gz + ".tmp";
+    gzFile out = gzopen(tmp.c_str(), "wb6");
+    if(out == nullptr) {
+        fprintf(stderr, "compress log %s failed: gzopen %s\n", path.c_str(), tmp.c_str());
+        ::close(in);
+        return false;
+    }
+    char buf[64 * 1024];
+    bool ok = true;
+    while(true) {
+        {
+            std::lock_guard<std::mutex> lock(mut_);
+            if(stop_) {
+                ok = false;
+                break;
+            }
+        }
+        ssize_t n = ::read(in, buf, sizeof buf);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        if(gzwrite(out, buf, static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    ok = gzclose(out) == Z_OK && ok;
+    ::close(in);
+    if(!ok || ::rename(tmp.c_str(), gz.c_str()) < 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    ::unlink(path.c_str());
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void LogArchiver::applyRetention(const Job& job) {
+    if(job.maxFiles == 0 && job.maxBytes == 0) {
+        return;
+    }
+    DIR* dir = ::opendir(job.dir.c_str());
+    if(dir == nullptr) {
+        return;
+    }
+    struct File {
+        std::pair<std::string, long> key;
+        std::string path;
+        size_t size;
+    };
+    std::vector<File> files;
+    const std::string prefix = job.baseName + ".";
+    while(struct dirent* entry = ::readdir(dir)) {
+        std::string name = entry->d_name;
+        if(name.compare(0, prefix.size(), prefix) != 0 || endsWith(name, ".tmp")) {
+            continue;
+        }
+        std::string path = job.dir + name;
+        struct stat st;
+        if(path == job.current || ::stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        files.push_back(File{ sortKey(name), path, static_cast<size_t>(st.st_size) });
+    }
+    ::closedir(dir);
+
+    // 从最新的文件开始累计，超出上限的 (更旧的) 删除
+    std::sort(files.begin(), files.end(),
+              [](const File& a, const File& b) { return a.key > b.key; });
+    size_t total = 0;
+    for(size_t i = 0; i < files.size(); i++) {
+        total += files[i].size;
+        if((job.maxFiles > 0 && i >= job.maxFiles) || (job.maxBytes > 0 && total > job.maxBytes)) {
+            ::unlink(files[i].path.c_str());
+        }
+    }
+}
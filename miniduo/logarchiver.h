@@ -0,0 +1,48 @@
+#pragma once
+// 切换后的日志文件的后台处理: 压缩 (gzip) 与按保留上限删除最旧的文件
+// Logger 的后台线程只把关闭的文件交给 LogArchiver, 压缩与扫描目录在它自己的线程中进行
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class LogArchiver {
+    LogArchiver(const LogArchiver&) = delete;
+    LogArchiver& operator=(const LogArchiver&) = delete;
+public:
+    /// 一个已关闭的日志文件以及处理它时的配置
+    struct Job {
+        std::string dir;      // 日志目录，以 '/' 结尾
+        std::string baseName; // 日志文件名前缀，目录中 "baseName." 开头的文件受保留上限管理
+        std::string closed;   // 刚关闭的文件的路径
+        std::string current;  // 正在写的文件的路径，不会被删除
+        bool compress;
+        size_t maxFiles;      // 除正在写的文件外最多保留的文件数，0 表示不限
+        size_t maxBytes;      // 除正在写的文件外最多占用的字节数，0 表示不限
+    };
+
+    /// @brief 编译时是否有 zlib; 没有时 Job::compress 被忽略
+    static bool compressionSupported();
+
+    LogArchiver();
+    /// 正在压缩的文件被中止，留下未压缩的原文件; 队列中其余的文件不再处理
+    ~LogArchiver();
+
+    void add(Job job);
+
+private:
+    void run();
+    void process(const Job& job);
+    // 把 path 压缩为 path.gz 后删除 path; 失败或被中止时保留 path
+    bool compressFile(const std::string& path);
+    void applyRetention(const Job& job);
+
+    std::mutex mut_;
+    std::condition_variable cv_;
+    std::deque<Job> jobs_;
+    bool stop_;
+    // 最后初始化
+    std::thread thread_;
+};
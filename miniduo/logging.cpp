@@ -1,4 +1,5 @@
 #include "logging.h"
+#include "logarchiver.h"
 
 
 #include <iostream>
@@ -12,14 +13,141 @@
 #include <fcntl.h> // ::open()
 #include <cstring> // ::strerror()
 #include <cassert>
+#include <sched.h> // sched_yield()
+#include <poll.h> // poll()
+#include <algorithm>
 
 
 #define FLUSH_SIZE 4 * 1024
 #define FLUSH_INTERVAL 3 
 #define FILE_SIZE 100 * 1024 * 1024 
 
+namespace {
+// 线程缓冲区中每条记录的头部
+struct LogRecordHeader {
+    uint32_t size;        // 整条记录的字节数，包括头部
+    int32_t reserved;
+    const LogSite* site;  // nullptr: 之后为已格式化的文本; 否则为编码后的参数
+    int64_t time;         // microseconds since the epoch, 只用于 site 非空的记录
+};
+
+int64_t nowMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+// 一个线程的日志环形缓冲区，单生产者 (所属线程) 单消费者 (后台线程)
+// head_ 与 tail_ 只增不减，取模 kSize 得到位置
+class LogThreadBuffer {
+    LogThreadBuffer(const LogThreadBuffer&) = delete;
+    LogThreadBuffer& operator=(const LogThreadBuffer&) = delete;
+public:
+    static const size_t kSize = 128 * 1024; // 2 的幂
+    static const int kMaxSpins = 50; // 缓冲区满时 sched_yield 的次数，之后等待后台唤醒
+
+    explicit LogThreadBuffer(int tid): tid_(tid), head_(0), tail_(0), retired_(false) {}
+
+    int tid() const { return tid_; }
+
+    // 生产者: 把一条记录 (不超过 kSize) 整体写入，后台不会取到半条日志
+    // 空间不足时唤醒后台线程，按 logger 的 OverflowPolicy 等待或丢弃
+    // @return false 表示这条日志被丢弃
+    bool append(Logger& logger, const char* data, size_t len, Logger::LogLevel level) {
+        assert(len <= kSize);
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t used = 0;
+        for(int spins = 0; ; spins++) {
+            // 先取 drain 的代数再检查空间，检查之后的 drain 不会被错过
+            uint64_t generation = logger.drainGeneration();
+            used = head - tail_.load(std::memory_order_acquire);
+            if(kSize - used >= len) {
+                break;
+            }
+            logger.requestFlush();
+            if(logger.mayDrop(level)) {
+                return false;
+            }
+            // 后台很快取走时让出 CPU 即可; 写得慢 (磁盘慢、日志风暴) 时睡眠等待，不空转
+            if(spins < kMaxSpins) {
+                sched_yield();
+            }
+            else {
+                logger.waitForDrain(generation);
+            }
+        }
+        copyIn(head, data, len);
+        head_.store(head + len, std::memory_order_release);
+        // 积累到 FLUSH_SIZE 时唤醒一次，之后等后台取走
+        if(used < FLUSH_SIZE && used + len >= FLUSH_SIZE) {
+            logger.requestFlush();
+        }
+        return true;
+    }
+
+    // 消费者: 取走所有数据追加到 out, 之前留下的不完整的记录在最前面
+    void drainTo(std::string* out) {
+        out->append(partial_);
+        partial_.clear();
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if(head == tail) {
+            return;
+        }
+        size_t begin = tail & (kSize - 1);
+        size_t n = head - tail;
+        size_t first = std::min(n, kSize - begin);
+        out->append(data_ + begin, first);
+        out->append(data_, n - first);
+        tail_.store(head, std::memory_order_release);
+    }
+
+    // 消费者: 取出的数据末尾不完整的记录留到下次 drainTo
+    void keepPartial(const char* data, size_t len) { partial_.assign(data, len); }
+
+    // 所属线程退出时调用，后台线程取完数据后释放
+    void retire() { retired_.store(true, std::memory_order_release); }
+    bool retired() const { return retired_.load(std::memory_order_acquire); }
+
+private:
+    void copyIn(size_t head, const char* data, size_t n) {
+        size_t begin = head & (kSize - 1);
+        size_t first = std::min(n, kSize - begin);
+        memcpy(data_ + begin, data, first);
+        memcpy(data_, data + first, n - first);
+    }
+
+    const int tid_;
+    std::atomic<size_t> head_; // 生产者写
+    char pad_[64 - sizeof(std::atomic<size_t>)]; // head_ 与 tail_ 不共享 cache line
+    std::atomic<size_t> tail_; // 消费者写
+    std::atomic<bool> retired_;
+    std::string partial_; // 只在后台线程使用
+    char data_[kSize];
+};
+
+const size_t LogThreadBuffer::kSize;
+const int LogThreadBuffer::kMaxSpins;
+
+namespace {
+// 线程退出时标记其缓冲区
+struct ThreadBufferHolder {
+    LogThreadBuffer* buffer = nullptr;
+    ~ThreadBufferHolder();
+};
+thread_local ThreadBufferHolder t_holder;
+__thread bool t_exited = false;
+
+ThreadBufferHolder::~ThreadBufferHolder() {
+    t_exited = true;
+    if(buffer != nullptr) {
+        buffer->retire();
+    }
+}
+} // namespace
+
 Logger::Logger()
-    : level_(LogLevel::DISABLE),
+    : flushRequested_(false),
       fileDir_("log/"),
       fileBaseName_("log"),
       rotateInterval_(24 * 60 * 60),
@@ -27,10 +155,30 @@ Logger::Logger()
       fd_(1),
       stopLogging_(false),
       isfilelog_(false),
+      format_(LogFormat::TEXT),
+      overflowPolicy_(OverflowPolicy::BLOCK),
+      keepLevel_(LogLevel::WARN),
+      droppedLines_(0),
+      droppedBytes_(0),
+      syncInterval_(0),
+      rotateSize_(FILE_SIZE),
+      compress_(false),
+      maxFiles_(0),
+      maxBytes_(0),
+      binaryFd_(-1),
+      drainStart_(0),
+      reportedDrops_(0),
+      reportedDropBytes_(0),
+      lastSync_(::time(nullptr)),
+      unsynced_(false),
+      fileNameSeq_(0),
+      fileSize_(0),
+      drainGeneration_(0),
+      drainWaiters_(0),
       backendThread_(std::thread(&Logger::flush, this))
 
 {   
-
+    setLogLevel(LogLevel::DISABLE);
     // msgQueue_.push_back("[Logger created] \n");
     // msg_.append("[Logger created] \n");
 }
@@ -51,40 +199,219 @@ Logger::~Logger() {
 }
 
 void Logger::flush() {
+    // 写缓冲在各轮之间复用，容量稳定后不再分配
+    std::string msg;
+    bool more = false;
     while(!stopLogging_) {
         // 检查fd_
         if(isfilelog_) {
             tryRotate();
         }
 
-        std::string msg;
-        std::unique_lock<std::mutex> lock(mut_);
-        while(msg_.empty() && !stopLogging_) {
-            // cv_.wait(lock);
-            cv_.wait_for(lock, std::chrono::seconds(FLUSH_INTERVAL));
-        }
-        // printf("msg_.capacity: %ld, before flush\n", msg_.capacity());
-        msg.swap(msg_);
-        lock.unlock();
-        const char *buf = msg.data();
-        int tosend = msg.size();
-        while(tosend > 0) {
-            int ret = ::write(fd_, buf, tosend);
-            if(ret > 0) {
-                buf += ret;
-                tosend -= ret;
+        // 上一批没有取完时不等待
+        if(!more) {
+            std::unique_lock<std::mutex> lock(mut_);
+            cv_.wait_for(lock, std::chrono::seconds(FLUSH_INTERVAL),
+                         [this] { return flushRequested_.load() || stopLogging_.load(); });
+            flushRequested_ = false;
+        }
+        more = drainBuffers(&msg);
+        writeAll(msg);
+        msg.clear();
+        trySync(false);
+    }
+    // 停止前写出剩余的日志
+    do {
+        more = drainBuffers(&msg);
+        writeAll(msg);
+        msg.clear();
+    } while(more);
+    trySync(true);
+}
+
+bool Logger::drainBuffers(std::string* out) {
+    static_assert(sizeof(LogRecordHeader) == kRecordHeader, "record header size");
+    if(format_ == LogFormat::BINARY && binaryFd_ != fd_) {
+        // 新文件 (包括切换后的文件) 从文件头开始，重新定义调用点
+        out->append(kBinaryLogMagic, sizeof kBinaryLogMagic);
+        siteIds_.clear();
+        binaryFd_ = fd_;
+    }
+    appendDropNotice(out);
+    std::lock_guard<std::mutex> lock(buffersMut_);
+    const size_t count = buffers_.size();
+    bool more = false;
+    size_t k = 0;
+    for(; k < count; k++) {
+        if(out->size() >= kMaxBatch) {
+            more = true;
+            break;
+        }
+        std::unique_ptr<LogThreadBuffer>& buffer = buffers_[(drainStart_ + k) % count];
+        // 先判断 retired 再取数据，退出前写入的日志不会丢失
+        bool retired = buffer->retired();
+        records_.clear();
+        buffer->drainTo(&records_);
+        size_t used = processRecords(records_, buffer->tid(), out);
+        buffer->keepPartial(records_.data() + used, records_.size() - used);
+        if(retired) {
+            buffer.reset();
+        }
+    }
+    drainStart_ = count > 0 ? (drainStart_ + k) % count : 0;
+    buffers_.erase(std::remove(buffers_.begin(), buffers_.end(), nullptr), buffers_.end());
+
+    // 唤醒等待缓冲区空间的线程; 没有线程等待时不加锁
+    drainGeneration_.fetch_add(1);
+    if(drainWaiters_.load() > 0) {
+        std::lock_guard<std::mutex> drainLock(drainMut_);
+        drainCv_.notify_all();
+    }
+    return more;
+}
+
+void Logger::waitForDrain(uint64_t generation) {
+    drainWaiters_.fetch_add(1);
+    {
+        std::unique_lock<std::mutex> lock(drainMut_);
+        // 超时只是保险: 后台线程已经停止 (进程退出过程中) 时不会永远等待
+        drainCv_.wait_for(lock, std::chrono::milliseconds(100),
+                          [&] { return drainGeneration_.load() != generation; });
+    }
+    drainWaiters_.fetch_sub(1);
+}
+
+void Logger::appendDropNotice(std::string* out) {
+    uint64_t lines = droppedLines_.load(std::memory_order_relaxed);
+    uint64_t bytes = droppedBytes_.load(std::memory_order_relaxed);
+    if(lines == reportedDrops_) {
+        return;
+    }
+    char text[kMaxPrefix + 128];
+    int n = formatPrefix(text);
+    n += snprintf(text + n, sizeof(text) - n, "[WARN ][logging] %llu log lines (%llu bytes) dropped\n",
+                  static_cast<unsigned long long>(lines - reportedDrops_),
+                  static_cast<unsigned long long>(bytes - reportedDropBytes_));
+    if(format_ == LogFormat::BINARY) {
+        appendBinaryLogText(out, text, n);
+    }
+    else {
+        out->append(text, n);
+    }
+    reportedDrops_ = lines;
+    reportedDropBytes_ = bytes;
+}
+
+void Logger::trySync(bool force) {
+    long interval = syncInterval_.load(std::memory_order_relaxed);
+    if(!isfilelog_ || interval <= 0 || !unsynced_) {
+        return;
+    }
+    time_t now = ::time(nullptr);
+    if(force || now - lastSync_ >= interval) {
+        ::fdatasync(fd_);
+        lastSync_ = now;
+        unsynced_ = false;
+    }
+}
+
+size_t Logger::processRecords(const std::string& records, int tid, std::string* out) {
+    const bool binary = format_ == LogFormat::BINARY;
+    size_t pos = 0;
+    while(pos + kRecordHeader <= records.size()) {
+        LogRecordHeader header;
+        memcpy(&header, records.data() + pos, sizeof header);
+        if(header.size < sizeof header || header.size > LogThreadBuffer::kSize) {
+            // 记录头损坏，之后的数据无法再分出记录，全部丢弃
+            fprintf(stderr, "corrupt log record (size %u), %zu bytes dropped\n",
+                    header.size, records.size() - pos);
+            return records.size();
+        }
+        if(pos + header.size > records.size()) {
+            break; // 不完整的记录，等下次取到其余部分
+        }
+        const char* body = records.data() + pos + sizeof header;
+        const size_t len = header.size - sizeof header;
+        pos += header.size;
+        if(header.site == nullptr) {
+            if(binary) {
+                appendBinaryLogText(out, body, len);
+            }
+            else {
+                out->append(body, len);
+            }
+        }
+        else if(binary) {
+            auto it = siteIds_.find(header.site);
+            if(it == siteIds_.end()) {
+                it = siteIds_.emplace(header.site, static_cast<uint32_t>(siteIds_.size())).first;
+                appendBinaryLogSite(out, it->second, *header.site);
             }
-            // printf("tosend %d\n", tosend);
+            appendBinaryLogEvent(out, it->second, header.time, tid, body, len);
+        }
+        else {
+            char timeStr[LogTimeFormatter::kLength + 1];
+            backendTime_.format(header.time, timeStr);
+            formatLogRecord(out, timeStr, tid, *header.site, body, len);
         }
-        // printf("msg_.capacity: %ld, after flush\n", msg_.capacity());
+    }
+    return pos;
+}
 
+void Logger::writeAll(const std::string& data) {
+    const char *buf = data.data();
+    size_t tosend = data.size();
+    while(tosend > 0) {
+        ssize_t ret = ::write(fd_, buf, tosend);
+        if(ret > 0) {
+            buf += ret;
+            tosend -= ret;
+            fileSize_ += ret;
+            unsynced_ = true;
+            continue;
+        }
+        if(ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if(ret < 0 && errno == EAGAIN) {
+            // 非阻塞的 fd (例如 stdout 是非阻塞的管道): 等到可写，而不是空转重试
+            struct pollfd pfd = { fd_, POLLOUT, 0 };
+            ::poll(&pfd, 1, 100);
+            continue;
+        }
+        // 写失败 (磁盘满等)，丢弃这一批剩余的数据; 此后的日志仍会继续尝试写入
+        // 条数按换行符计，BINARY 模式下只是估计
+        droppedLines_.fetch_add(std::count(buf, buf + tosend, '\n'), std::memory_order_relaxed);
+        droppedBytes_.fetch_add(tosend, std::memory_order_relaxed);
+        fprintf(stderr, "write log failed: %s, %zu bytes dropped\n", ::strerror(errno), tosend);
+        return;
     }
+}
 
+void Logger::requestFlush() {
+    // 已有未处理的请求时不再唤醒; 置位后再加锁通知，后台在锁内检查标志，不会错过
+    if(!flushRequested_.exchange(true)) {
+        std::lock_guard<std::mutex> lock(mut_);
+        cv_.notify_one();
+    }
+}
+
+LogThreadBuffer* Logger::threadBuffer() {
+    if(t_exited) {
+        return nullptr;
+    }
+    if(t_holder.buffer == nullptr) {
+        std::unique_ptr<LogThreadBuffer> buffer(new LogThreadBuffer(::gettid()));
+        t_holder.buffer = buffer.get();
+        std::lock_guard<std::mutex> lock(buffersMut_);
+        buffers_.push_back(std::move(buffer));
+    }
+    return t_holder.buffer;
 }
 
 void Logger::switchToFileLog() {
     assert(fd_ == 1);
-    ::mkdir(fileDir_.c_str(), 0);
+    ::mkdir(fileDir_.c_str(), 0755);
     int newfd = openNewLogfile();
     setfd(newfd);
     // isfilelog_ = true;
@@ -96,20 +423,39 @@ int Logger::openNewLogfile() {
     struct tm ntm;
     ::localtime_r(&lastRotate_, &ntm);
     char newname[4096];
-    ::snprintf( newname, sizeof(newname), 
+    int n = ::snprintf( newname, sizeof(newname), 
                 "%s%s.%d%02d%02d-%02d%02d%02d", 
                 fileDir_.c_str(), fileBaseName_.c_str(), 
                 ntm.tm_year + 1900, ntm.tm_mon + 1, ntm.tm_mday, ntm.tm_hour, ntm.tm_min, ntm.tm_sec); 
-    int fd = ::open(newname, O_APPEND | O_CREAT | O_WRONLY | O_CLOEXEC, DEFFILEMODE);
+    // 同一秒内按大小切换多次时依次加 ".1" ".2" ...
+    // 不能追加到旧文件，也不能与已压缩 (原文件已删除) 的旧文件同名
+    const std::string base(newname, std::max(n, 0));
+    int seq = base == fileNameBase_ ? fileNameSeq_ + 1 : 0;
+    std::string name;
+    int fd = -1;
+    for(; ; seq++) {
+        name = seq == 0 ? base : base + "." + std::to_string(seq);
+        if(::access((name + ".gz").c_str(), F_OK) == 0) {
+            continue;
+        }
+        fd = ::open(name.c_str(), O_APPEND | O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, DEFFILEMODE);
+        if(fd >= 0 || errno != EEXIST) {
+            break;
+        }
+    }
     if(fd < 0) {
-        fprintf(stderr, "open log file %s failed. msg: %s ignored\n", newname, ::strerror(errno));
+        fprintf(stderr, "open log file %s failed. msg: %s ignored\n", name.c_str(), ::strerror(errno));
         exit(1);
     }
+    fileNameBase_ = base;
+    fileNameSeq_ = seq;
+    currentFile_ = name;
+    fileSize_ = 0;
     return fd;
 }
 
-Logger::LogStream Logger::streamLogv(LogLevel level) {
-    return LogStream(*this, level);
+Logger::LogStream Logger::streamLogv(LogLevel level, LogModule module) {
+    return LogStream(*this, level, module);
 }
 
 
@@ -117,34 +463,77 @@ void Logger::logv(const LogLevel level,
                 const char* fmt, ...) 
 {
 
-    if (level < level_) return ;
+    if (level < getLogLevel()) return ;
 
-    char buffer[ 4096 ];
+    // 前缀、消息和换行都在栈上格式化，过长的消息被截断
+    char record[ kRecordHeader + 4096 + kMaxPrefix ];
+    char* buffer = record + kRecordHeader;
+    const int size = sizeof(record) - kRecordHeader;
+    int n = formatPrefix(buffer);
 
     va_list args;
     va_start(args, fmt);
-    int n = vsnprintf(buffer, sizeof(buffer), fmt, args);
+    int len = vsnprintf(buffer + n, size - n, fmt, args);
     va_end(args);
+    if(len > 0) {
+        n += std::min(len, size - n - 1);
+    }
+    buffer[n++] = '\n';
 
-    append(std::string(buffer, n));
+    appendText(level, record, n);
     
 }
 
+void Logger::logText(LogLevel level, const LogSite* site, ...) {
+    char record[ kRecordHeader + 4096 + kMaxPrefix ];
+    char* buffer = record + kRecordHeader;
+    const int size = sizeof(record) - kRecordHeader;
+    int n = formatPrefix(buffer);
+    int len = snprintf(buffer + n, size - n, "%s[%s:%d][%s]: ",
+                       site->levelstr, site->file, site->line, site->function);
+    if(len > 0) {
+        n += std::min(len, size - n - 1);
+    }
+
+    va_list args;
+    va_start(args, site);
+    len = vsnprintf(buffer + n, size - n, site->format, args);
+    va_end(args);
+    if(len > 0) {
+        n += std::min(len, size - n - 1);
+    }
+    buffer[n++] = '\n';
+
+    appendText(level, record, n);
+}
+
 
 void Logger::tryRotate() {
     if(!isfilelog_) return ;
     time_t now = ::time(nullptr);
     long interval = now - lastRotate_;
-    struct stat filestat;
-    ::fstat(fd_, &filestat);
-    if(interval < rotateInterval_ && filestat.st_size < FILE_SIZE) {
+    if(interval < rotateInterval_ && fileSize_ < rotateSize_.load(std::memory_order_relaxed)) {
         return ;
     }
     lastRotate_ = now;
+    trySync(true);
     ::close(fd_);
+    const std::string closed = currentFile_;
     int newfd = openNewLogfile();
     setfd(newfd);
 
+    // 压缩与清理在 LogArchiver 的线程中进行，不阻塞写日志
+    const bool compress = compress_.load(std::memory_order_relaxed);
+    const size_t maxFiles = maxFiles_.load(std::memory_order_relaxed);
+    const size_t maxBytes = maxBytes_.load(std::memory_order_relaxed);
+    if(!compress && maxFiles == 0 && maxBytes == 0) {
+        return;
+    }
+    if(!archiver_) {
+        archiver_.reset(new LogArchiver);
+    }
+    archiver_->add(LogArchiver::Job{ fileDir_, fileBaseName_, closed, currentFile_,
+                                     compress, maxFiles, maxBytes });
 }
 
 Logger& Logger::getLogger() {
@@ -153,50 +542,155 @@ Logger& Logger::getLogger() {
 }
 
 
-std::string Logger::timeNow() {
+const int LogTimeFormatter::kLength;
+
+int LogTimeFormatter::format(int64_t microseconds, char* buf) {
+    const int64_t second = microseconds / 1000000;
+    if(second != cachedSecond_) {
+        time_t tt = static_cast<time_t>(second);
+        struct tm timeinfo;
+        // struct tm* timeinfo = localtime(&tt); // not thread safe
+        localtime_r(&tt, &timeinfo); // thread safe
+        int n = snprintf(cached_, sizeof(cached_), "%04d-%02d-%02d %02d:%02d:%02d.",
+                 timeinfo.tm_year + 1900,
+                 timeinfo.tm_mon + 1,
+                 timeinfo.tm_mday,
+                 timeinfo.tm_hour,
+                 timeinfo.tm_min,
+                 timeinfo.tm_sec);
+        assert(n == kLength - 3);
+        (void) n;
+        cachedSecond_ = second;
+    }
+    memcpy(buf, cached_, kLength - 3);
+    int ms = static_cast<int>(microseconds / 1000 % 1000);
+    buf[kLength - 3] = static_cast<char>('0' + ms / 100);
+    buf[kLength - 2] = static_cast<char>('0' + ms / 10 % 10);
+    buf[kLength - 1] = static_cast<char>('0' + ms % 10);
+    buf[kLength] = '\0';
+    return kLength;
+}
+
+int Logger::formatPrefix(char* buf) {
+    static thread_local LogTimeFormatter formatter;
     auto now = std::chrono::system_clock::now();
-    time_t tt = std::chrono::system_clock::to_time_t(now);
-    struct tm timeinfo;
-    // struct tm* timeinfo = localtime(&tt); // not thread safe
-    localtime_r(&tt, &timeinfo); // thread safe
-    
-    char timeStr [100];
-    int n = snprintf(timeStr, sizeof(timeStr),"%04d-%02d-%02d %02d:%02d:%02d.%3d",
-             timeinfo.tm_year + 1900,
-             timeinfo.tm_mon + 1,
-             timeinfo.tm_mday,
-             timeinfo.tm_hour,
-             timeinfo.tm_min,
-             timeinfo.tm_sec,
-             (int)(std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000));
-    assert(n >= 0);
-    return std::string(timeStr, n);
-}
-
-std::string Logger::tid() {
-    static __thread pid_t currTid = ::gettid();
-    return std::to_string(currTid);
-}
-
-void Logger::append(const std::string &msg) {
-    std::string &&logmsg = "[" + timeNow() + "]" +
-                           "[" + tid()     + "]" +
-                           msg +
-                           "\n";
-    std::unique_lock<std::mutex> lock(mut_);
-    // msgQueue_.push_back(std::move(logmsg));
-    // if(msgQueue_.size() >= 100) {
-    //     cv_.notify_one();
-    // }
-    msg_.append(logmsg);
-    if(msg_.size() >= FLUSH_SIZE) {
-        cv_.notify_one();
+    int n = 0;
+    buf[n++] = '[';
+    n += formatter.format(
+        std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count(),
+        buf + n);
+    buf[n++] = ']';
+    buf[n++] = '[';
+    const std::string& id = tid();
+    memcpy(buf + n, id.data(), id.size());
+    n += id.size();
+    buf[n++] = ']';
+    assert(n < kMaxPrefix);
+    return n;
+}
+
+const std::string& Logger::tid() {
+    static thread_local std::string currTid = std::to_string(::gettid());
+    return currTid;
+}
+
+void Logger::append(LogLevel level, const char* record, size_t size) {
+    LogThreadBuffer* buffer = threadBuffer();
+    if(buffer != nullptr) {
+        if(!buffer->append(*this, record, size, level)) {
+            noteDropped(size - kRecordHeader);
+        }
+        return;
+    }
+    // 线程退出过程中 (thread_local 析构) 的日志
+    LogRecordHeader header;
+    memcpy(&header, record, sizeof header);
+    if(header.site == nullptr) {
+        ::write(fd_, record + sizeof header, size - sizeof header);
+    }
+    else {
+        char timeStr[LogTimeFormatter::kLength + 1];
+        LogTimeFormatter().format(header.time, timeStr);
+        std::string text;
+        formatLogRecord(&text, timeStr, ::gettid(), *header.site,
+                        record + sizeof header, size - sizeof header);
+        ::write(fd_, text.data(), text.size());
+    }
+}
+
+void Logger::appendText(LogLevel level, char* record, size_t textLen) {
+    LogRecordHeader header = { static_cast<uint32_t>(kRecordHeader + textLen), 0, nullptr, 0 };
+    memcpy(record, &header, sizeof header);
+    append(level, record, header.size);
+}
+
+void Logger::appendRecord(LogLevel level, const LogSite* site, char* record, size_t argsLen) {
+    LogRecordHeader header = { static_cast<uint32_t>(kRecordHeader + argsLen), 0, site,
+                               nowMicroseconds() };
+    memcpy(record, &header, sizeof header);
+    append(level, record, header.size);
+}
+
+bool Logger::mayDrop(LogLevel level) const {
+    switch(overflowPolicy_.load(std::memory_order_relaxed)) {
+    case OverflowPolicy::DROP_NEWEST:
+        return true;
+    case OverflowPolicy::DROP_BY_LEVEL:
+        return level < keepLevel_.load(std::memory_order_relaxed);
+    default:
+        return false;
     }
 }
 
+void Logger::append(LogLevel level, const std::string &msg) {
+    // 拼成一条后整体写入，与其他线程的日志不交错
+    // 与 logv 一样截断过长的消息，一条记录不能超过线程缓冲区
+    char prefix[kMaxPrefix];
+    int n = formatPrefix(prefix);
+    const size_t len = std::min(msg.size(), LogThreadBuffer::kSize - kRecordHeader - n - 1);
+    std::string record(kRecordHeader, '\0');
+    record.reserve(kRecordHeader + n + len + 1);
+    record.append(prefix, n);
+    record.append(msg, 0, len);
+    record.push_back('\n');
+    appendText(level, &record[0], record.size() - kRecordHeader);
+}
+
 
 void Logger::setLogLevel(LogLevel level) {
-    level_ = level;
+    for(auto& l: levels_) {
+        l.store(level, std::memory_order_relaxed);
+    }
+}
+
+void Logger::setLogLevel(LogModule module, LogLevel level) {
+    levels_[static_cast<int>(module)].store(level, std::memory_order_relaxed);
+}
+
+void Logger::setOverflowPolicy(OverflowPolicy policy, LogLevel keepLevel) {
+    keepLevel_.store(keepLevel, std::memory_order_relaxed);
+    overflowPolicy_.store(policy, std::memory_order_relaxed);
+}
+
+void Logger::setRotateSize(size_t bytes) {
+    rotateSize_.store(bytes, std::memory_order_relaxed);
+}
+
+bool Logger::setCompressRotated(bool enable) {
+    if(enable && !LogArchiver::compressionSupported()) {
+        return false;
+    }
+    compress_.store(enable, std::memory_order_relaxed);
+    return true;
+}
+
+void Logger::setRetention(size_t maxFiles, size_t maxBytes) {
+    maxFiles_.store(maxFiles, std::memory_order_relaxed);
+    maxBytes_.store(maxBytes, std::memory_order_relaxed);
+}
+
+void Logger::setSyncInterval(long seconds) {
+    syncInterval_.store(seconds, std::memory_order_relaxed);
 }
 
 void Logger::setFileBaseName(std::string basename) {
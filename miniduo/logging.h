@@ -5,26 +5,74 @@
 #include <list>
 #include <atomic>
 #include <sstream>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "logrecord.h"
+
+// 编译期最低日志级别，低于它的 log_* / streamlog_* 调用在预处理时被去掉 (参数也不再求值)
+// 取 Logger::LogLevel 的值: 0 ALL, 1 TRACE, 2 DEBUG, 3 INFO, 4 WARN, 5 ERROR, 6 FATAL
+// 例如 make OPT="-O2 -DMINIDUO_LOG_MIN_LEVEL=3" 去掉所有 TRACE 和 DEBUG
+#ifndef MINIDUO_LOG_MIN_LEVEL
+#define MINIDUO_LOG_MIN_LEVEL 0
+#endif
+
+// 日志调用所属的模块，决定使用哪个模块的运行时级别
+// 在宏展开处求值，源文件在 include 之后 #undef 并重新定义即可改变本文件的模块
+#define MINIDUO_LOG_MODULE Logger::LogModule::DEFAULT
 
 // 格式化log
-#define log(level, levelstr, format, args...)    \
+// 调用点的文件、行号、函数与格式串放在 static 的 LogSite 中，deferred 模式下只记录其地址
+#define log_module(module, level, levelstr, format, args...)    \
     do {                   \
-        if( level >= Logger::getLogger().getLogLevel()) {   \
-            Logger::getLogger().logv(level,  levelstr "[%s:%d][%s]: " format, __FILE__, __LINE__, __FUNCTION__, ##args); \
+        if( Logger::getLogger().isEnabled(module, level) ) {   \
+            static const LogSite _logSite = { levelstr, __FILE__, __LINE__, __FUNCTION__, format }; \
+            Logger::getLogger().logSite(level, &_logSite, ##args); \
         }   \
     } while(0) 
 
+#define log(level, levelstr, ...) log_module(MINIDUO_LOG_MODULE, level, levelstr, __VA_ARGS__)
+
+#define _log_nothing(...) do { } while(0)
 
+#if MINIDUO_LOG_MIN_LEVEL <= 1
 #define log_trace(...) log(Logger::LogLevel::TRACE, "[TRACE]", __VA_ARGS__)      
+#else
+#define log_trace(...) _log_nothing(__VA_ARGS__)
+#endif
+#if MINIDUO_LOG_MIN_LEVEL <= 2
 #define log_debug(...) log(Logger::LogLevel::DEBUG, "[DEBUG]", __VA_ARGS__)      
+#else
+#define log_debug(...) _log_nothing(__VA_ARGS__)
+#endif
+#if MINIDUO_LOG_MIN_LEVEL <= 3
 #define log_info(...)  log(Logger::LogLevel::INFO , "[INFO ]", __VA_ARGS__)        
+#else
+#define log_info(...)  _log_nothing(__VA_ARGS__)
+#endif
+#if MINIDUO_LOG_MIN_LEVEL <= 4
 #define log_warn(...)  log(Logger::LogLevel::WARN , "[WARN ]", __VA_ARGS__)        
+#else
+#define log_warn(...)  _log_nothing(__VA_ARGS__)
+#endif
+#if MINIDUO_LOG_MIN_LEVEL <= 5
 #define log_error(...) log(Logger::LogLevel::ERROR, "[ERROR]", __VA_ARGS__)      
+#else
+#define log_error(...) _log_nothing(__VA_ARGS__)
+#endif
+#if MINIDUO_LOG_MIN_LEVEL <= 6
 #define log_fatal(...) log(Logger::LogLevel::FATAL, "[FATAL]", __VA_ARGS__)   
+#else
+#define log_fatal(...) _log_nothing(__VA_ARGS__)
+#endif
 
 // 流输出log
+// 编译期被去掉的级别整条语句不执行；if-else 形式使 "streamlog_x << ..." 仍是一条语句
 #define streamlog(level, levelstr) \
-    Logger::getLogger().streamLogv(level)<<levelstr<<"["<<__FILE__<<":"<<__LINE__<<"]"<<"["<< __FUNCTION__ <<"]: "
+    if( static_cast<int>(level) < MINIDUO_LOG_MIN_LEVEL \
+        || !Logger::getLogger().isEnabled(MINIDUO_LOG_MODULE, level) ) {} \
+    else Logger::getLogger().streamLogv(level, MINIDUO_LOG_MODULE)<<levelstr<<"["<<__FILE__<<":"<<__LINE__<<"]"<<"["<< __FUNCTION__ <<"]: "
 
 #define streamlog_trace streamlog(Logger::LogLevel::TRACE, "[TRACE]")
 #define streamlog_debug streamlog(Logger::LogLevel::DEBUG, "[DEBUG]")
@@ -45,9 +93,16 @@
     } while(0)
 
 #define set_logLevel(l) Logger::getLogger().setLogLevel(l)
+#define set_logModuleLevel(m, l) Logger::getLogger().setLogLevel(m, l)
 #define set_logName(n)  Logger::getLogger().setFileBaseName(n)
 #define set_logInterval(i) Logger::getLogger().setRotateInterval(i)
+#define set_logRotateSize(s) Logger::getLogger().setRotateSize(s)
+#define set_logCompress(b) Logger::getLogger().setCompressRotated(b)
+#define set_logRetention(files, bytes) Logger::getLogger().setRetention(files, bytes)
 #define set_logSwitchToFileLog() Logger::getLogger().switchToFileLog()
+#define set_logFormat(f) Logger::getLogger().setLogFormat(f)
+#define set_logOverflowPolicy(p) Logger::getLogger().setOverflowPolicy(p)
+#define set_logSyncInterval(i) Logger::getLogger().setSyncInterval(i)
 
 static std::string _CutParenthesesNTail(std::string&& prettyFunction) {
     auto pos = prettyFunction.find('(');
@@ -59,7 +114,35 @@ static std::string _CutParenthesesNTail(std::string&& prettyFunction) {
 
 #define __STR_FUNCTION__ _CutParenthesesNTail(std::string(__PRETTY_FUNCTION__)).c_str()
 
+// 日志时间戳 "YYYY-mm-dd HH:MM:SS.mmm"
+// 同一秒内复用已格式化的日期时间部分，只重新填写毫秒，不再调用 localtime_r 和 snprintf
+// 不是线程安全的，每个线程一个
+class LogTimeFormatter {
+public:
+    static const int kLength = 23;
+
+    LogTimeFormatter(): cachedSecond_(-1) {}
+    /// @brief microseconds since the epoch 格式化到 buf (至少 kLength + 1 字节)
+    /// @return 写入的长度 kLength
+    int format(int64_t microseconds, char* buf);
+
+private:
+    int64_t cachedSecond_;
+    char cached_[kLength + 1]; // cachedSecond_ 对应的 "YYYY-mm-dd HH:MM:SS."
+};
+
+
+class LogThreadBuffer;
+class LogArchiver;
 
+/// 前端: 每个写日志的线程一个无锁的单生产者环形缓冲区，格式化在栈上完成后拷入，
+/// 每条日志不加锁也不分配内存；缓冲区写满时唤醒后台线程并等待
+/// 后台: 定期或被唤醒时取走所有环形缓冲区中的数据，拼入复用的写缓冲后写入文件
+/// 同一线程的日志保持顺序，不同线程之间按后台取走的批次交错
+/// 缓冲区中每条记录带有记录头，可以是已格式化的文本，也可以是 deferred 模式下
+/// 调用点的地址加编码后的参数 (见 logrecord.h)
+/// 内存有上界: 每个线程一个定长缓冲区，后台每批最多取 kMaxBatch 字节左右后写出；
+/// 写得比产生慢时按 OverflowPolicy 阻塞调用线程或丢弃日志，丢弃的数量被记录并写入日志
 class Logger {
 
     Logger(const Logger&) = delete;
@@ -70,19 +153,85 @@ private:
 public:
     enum class LogLevel { ALL = 0, TRACE, DEBUG, INFO, 
                         WARN, ERROR, FATAL, DISABLE };
+    /// 运行时级别按模块分开设置，例如只打开 HTTP 解析的 TRACE 而不影响 poller
+    enum class LogModule {
+        DEFAULT = 0, // 未指定模块的日志与 logv
+        NET,         // EventLoop, poller, channel, TcpConnection, TcpServer
+        HTTP,        // HttpServer, http 解析
+        TIMER,       // TimerQueue, TimerWheel
+        COUNT
+    };
+    /// log_* 宏的格式化方式，流输出始终在调用线程格式化
+    enum class LogFormat {
+        TEXT,     // 调用线程用 vsnprintf 格式化 (默认)
+        DEFERRED, // 调用线程只记录调用点、时间和参数的原始值，由后台线程格式化为文本
+        BINARY,   // 同 DEFERRED, 后台线程写出二进制记录，由 tools/logdecode 解码为文本
+    };
+    /// 线程缓冲区写满 (后台写得比日志产生慢) 时的处理
+    enum class OverflowPolicy {
+        BLOCK,         // 等待后台取走，不丢日志 (默认)
+        DROP_NEWEST,   // 丢弃写不下的这条日志
+        DROP_BY_LEVEL, // 低于 setOverflowPolicy 指定级别的日志丢弃，其余等待
+    };
     ~Logger();
 
     static Logger& getLogger();
     void logv(const LogLevel level, 
               const char* fmt, ...);
-    LogStream streamLogv(LogLevel level);
+    /// @brief log_* 宏调用; 参数只支持整数、枚举、浮点数、C 字符串和指针
+    /// DEFERRED / BINARY 模式下字符串参数被拷贝，其余按值记录
+    template <typename... Args>
+    void logSite(LogLevel level, const LogSite* site, const Args&... args) {
+        if(format_.load(std::memory_order_relaxed) == LogFormat::TEXT) {
+            logText(level, site, args...);
+            return;
+        }
+        char record[kMaxRecord];
+        LogArgEncoder encoder(record + kRecordHeader, sizeof(record) - kRecordHeader);
+        encoder.addAll(args...);
+        appendRecord(level, site, record, encoder.size());
+    }
+    LogStream streamLogv(LogLevel level, LogModule module = LogModule::DEFAULT);
 
     void switchToFileLog();
+    /// @brief 设置所有模块的级别
     void setLogLevel(LogLevel level);
+    /// @brief 只设置一个模块的级别
+    void setLogLevel(LogModule module, LogLevel level);
     void setFileBaseName(std::string basename);
     void setRotateInterval(long interval);
-    LogLevel getLogLevel() const {
-        return level_;
+    /// @brief 文件日志写满 bytes 字节后切换，默认 100 MiB
+    void setRotateSize(size_t bytes);
+    /// @brief 切换后在后台把关闭的文件压缩为 .gz
+    /// @return 编译时没有 zlib 时返回 false, 文件保持不压缩
+    bool setCompressRotated(bool enable);
+    /// @brief 日志目录中除正在写的文件外最多保留 maxFiles 个、共 maxBytes 字节的文件，
+    /// 每次切换后在后台删除最旧的; 0 表示不限 (默认)
+    void setRetention(size_t maxFiles, size_t maxBytes);
+    LogLevel getLogLevel(LogModule module = LogModule::DEFAULT) const {
+        return levels_[static_cast<int>(module)].load(std::memory_order_relaxed);
+    }
+    bool isEnabled(LogModule module, LogLevel level) const {
+        return level >= getLogLevel(module);
+    }
+    /// @brief TEXT 与 DEFERRED 可随时切换; BINARY 需在写日志前设置，
+    /// 否则文件头之前的文本无法解码
+    void setLogFormat(LogFormat format) {
+        format_.store(format, std::memory_order_relaxed);
+    }
+    LogFormat getLogFormat() const {
+        return format_.load(std::memory_order_relaxed);
+    }
+    /// @param keepLevel DROP_BY_LEVEL 时不丢弃的最低级别
+    void setOverflowPolicy(OverflowPolicy policy, LogLevel keepLevel = LogLevel::WARN);
+    /// @brief 文件日志每隔 seconds 秒 fdatasync 一次，0 (默认) 表示不主动同步
+    void setSyncInterval(long seconds);
+    /// 因缓冲区写满或写文件失败而丢弃的日志条数与字节数 (累计)
+    uint64_t droppedLines() const {
+        return droppedLines_.load(std::memory_order_relaxed);
+    }
+    uint64_t droppedBytes() const {
+        return droppedBytes_.load(std::memory_order_relaxed);
     }
 
 private:
@@ -93,20 +242,57 @@ private:
     // 尝试切换log文件，只在后台线程中被调用
     void tryRotate(); 
 
-    // 新建一个logfile，根据lastRotate_时间
+    // 新建一个logfile，根据lastRotate_时间; 同一秒内的文件加 ".N"
+    // 设置 currentFile_ 与 fileSize_
     int openNewLogfile();
     
-    // 后台线程执行，把 消息队列flush进磁盘 lock && flush
+    // 后台线程执行，取走各线程缓冲区中的日志写入文件
     void flush();
+    // 从上次停下的线程缓冲区开始依次取走数据追加到 out, 释放已退出线程的缓冲区
+    // out 达到 kMaxBatch 时停止，返回 true 表示还有缓冲区没有取
+    bool drainBuffers(std::string* out);
+    // 有新丢弃的日志时在 out 中加一条说明
+    void appendDropNotice(std::string* out);
+    // 到了 syncInterval_ 时 fdatasync
+    void trySync(bool force);
+    // 把一个线程缓冲区取出的记录格式化 (或按 BINARY 编码) 追加到 out
+    // 返回处理了的字节数，之后是不完整的记录
+    size_t processRecords(const std::string& records, int tid, std::string* out);
+    void writeAll(const std::string& data);
 
-    // 生成时间信息string
-    std::string timeNow() ;
+    // 写入 "[时间][tid]" 前缀，返回长度; buf 至少 kMaxPrefix 字节
+    int formatPrefix(char* buf);
 
-    // 生成线程id 
-    std::string tid();
+    // 生成线程id, 每个线程缓存
+    const std::string& tid();
+
+    // 当前线程的缓冲区，首次调用时创建并登记; 线程退出过程中返回 nullptr
+    LogThreadBuffer* threadBuffer();
+    // 写入当前线程的缓冲区，线程已退出时格式化后直接写 fd_
+    void append(LogLevel level, const char* record, size_t size);
+    // record 开头预留 kRecordHeader 字节，之后为 textLen 字节的文本
+    void appendText(LogLevel level, char* record, size_t textLen);
+    // record 开头预留 kRecordHeader 字节，之后为 argsLen 字节的参数
+    void appendRecord(LogLevel level, const LogSite* site, char* record, size_t argsLen);
+    // 加上前缀和换行后 append, 用于流输出
+    void append(LogLevel level, const std::string &msg);
+    // TEXT 模式: 在调用线程格式化
+    void logText(LogLevel level, const LogSite* site, ...);
+
+    // 线程缓冲区写满时，这条日志能否丢弃
+    bool mayDrop(LogLevel level) const;
+    void noteDropped(size_t bytes) {
+        droppedLines_.fetch_add(1, std::memory_order_relaxed);
+        droppedBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
 
-    // lock && append
-    void append(const std::string &msg);
+    // 前端: 缓冲区积累的数据达到阈值或写满时唤醒后台线程
+    void requestFlush();
+    // 前端: 缓冲区写满时等待后台完成一轮 drain (drainGeneration() 不再等于 generation)
+    uint64_t drainGeneration() const {
+        return drainGeneration_.load();
+    }
+    void waitForDrain(uint64_t generation);
 
     void setfd(const int fd) {
         fd_ = fd;
@@ -117,34 +303,81 @@ private:
     }
 
 private:
-    std::mutex mut_;
+    friend class LogThreadBuffer;
+    static const int kMaxPrefix = 64;
+    static const int kRecordHeader = 24; // 记录头 LogRecordHeader 的大小
+    static const int kMaxRecord = 4096;
+    static const size_t kMaxBatch = 1024 * 1024; // 后台一次写出的大约上限
+
+    std::mutex mut_; // 只保护 cv_ 的等待与唤醒
     std::condition_variable cv_;
     // std::list<std::string> msgQueue_; // replaced by msg_
-    std::string msg_;
+    // std::string msg_; // replaced by buffers_
+    std::atomic<bool> flushRequested_;
+    std::mutex buffersMut_; // 保护 buffers_, 只在线程首次写日志时和后台取数据时获取
+    std::vector<std::unique_ptr<LogThreadBuffer>> buffers_;
 
-    std::thread backendThread_;
     std::atomic<bool> stopLogging_;
     std::atomic<bool> isfilelog_; // true: file log; false: stdout log
     std::string fileBaseName_;
     std::string fileDir_;
     int fd_;
-    LogLevel level_; /// FIXME: atomic
     time_t lastRotate_;
     long rotateInterval_; // seconds
+    std::atomic<LogFormat> format_;
+    // 每条日志都要读，各模块的级别放在同一个缓存行，只在设置时写
+    alignas(64) std::atomic<LogLevel> levels_[static_cast<int>(LogModule::COUNT)];
+    // 只在线程缓冲区写满时读
+    std::atomic<OverflowPolicy> overflowPolicy_;
+    std::atomic<LogLevel> keepLevel_;
+    std::atomic<uint64_t> droppedLines_;
+    std::atomic<uint64_t> droppedBytes_;
+    std::atomic<long> syncInterval_; // seconds
+    std::atomic<size_t> rotateSize_;
+    std::atomic<bool> compress_;
+    std::atomic<size_t> maxFiles_;
+    std::atomic<size_t> maxBytes_;
+
+    // 只在后台线程中使用
+    LogTimeFormatter backendTime_;
+    std::string records_; // 从一个线程缓冲区取出的记录
+    std::unordered_map<const LogSite*, uint32_t> siteIds_; // BINARY: 当前文件中已定义的调用点
+    int binaryFd_; // BINARY: 已写入文件头的 fd, -1 表示还没有
+    size_t drainStart_; // 下一批从哪个线程缓冲区开始取，使各线程轮流先被取
+    uint64_t reportedDrops_; // 已写入说明的丢弃条数
+    uint64_t reportedDropBytes_;
+    time_t lastSync_;
+    bool unsynced_; // 上次 fdatasync 之后写过数据
+    std::string fileNameBase_; // 当前文件名中 ".N" 之前的部分
+    int fileNameSeq_;
+    std::string currentFile_;
+    size_t fileSize_; // 当前文件已写入的字节数，代替每次 fstat
+    std::unique_ptr<LogArchiver> archiver_; // 第一次切换文件时创建
+
+    // 缓冲区写满的线程在 drainCv_ 上等待，后台每轮 drain 后递增 drainGeneration_
+    std::mutex drainMut_;
+    std::condition_variable drainCv_;
+    std::atomic<uint64_t> drainGeneration_;
+    std::atomic<int> drainWaiters_;
+
+    // 最后初始化，启动时其他成员都已构造
+    std::thread backendThread_;
 
 };
 
 class Logger::LogStream: public std::ostringstream {
 public:
-    LogStream(Logger& logger, LogLevel level): logger_(logger), level_(level) {}
+    LogStream(Logger& logger, LogLevel level, LogModule module)
+        : logger_(logger), level_(level), module_(module) {}
     // 拷贝构造函数
-    LogStream(const LogStream &ls): logger_(ls.logger_), level_(ls.level_) {}
+    LogStream(const LogStream &ls): logger_(ls.logger_), level_(ls.level_), module_(ls.module_) {}
     ~LogStream() {
-        if(level_ >= logger_.getLogLevel()) {
-            logger_.append(str());
+        if(level_ >= logger_.getLogLevel(module_)) {
+            logger_.append(level_, str());
         }
     }
 private:
     Logger& logger_;
     LogLevel level_;
+    LogModule module_;
 };
\ No newline at end of file
@@ -0,0 +1,399 @@
+#include "logrecord.h"
+#include "logging.h" // LogTimeFormatter
+
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+const char kBinaryLogMagic[8] = {'M', 'D', 'L', 'O', 'G', 'B', '1', '\n'};
+
+namespace {
+
+// 解码出的一个参数
+struct LogArg {
+    char tag;
+    int64_t i;
+    uint64_t u;
+    double d;
+    const char* s;
+    uint32_t len;
+};
+
+bool readArg(const char*& p, const char* end, LogArg* arg) {
+    if(p >= end) {
+        return false;
+    }
+    arg->tag = *p++;
+    switch(arg->tag) {
+    case kLogArgInt:
+    case kLogArgUint:
+    case kLogArgPointer:
+    case kLogArgDouble:
+        if(end - p < 8) {
+            return false;
+        }
+        if(arg->tag == kLogArgInt) {
+            memcpy(&arg->i, p, 8);
+        }
+        else if(arg->tag == kLogArgDouble) {
+            memcpy(&arg->d, p, 8);
+        }
+        else {
+            memcpy(&arg->u, p, 8);
+        }
+        p += 8;
+        return true;
+    case kLogArgString:
+        if(end - p < 4) {
+            return false;
+        }
+        memcpy(&arg->len, p, 4);
+        p += 4;
+        if(static_cast<size_t>(end - p) < arg->len) {
+            return false;
+        }
+        arg->s = p;
+        p += arg->len;
+        return true;
+    default:
+        return false;
+    }
+}
+
+int64_t asInt(const LogArg& arg) {
+    switch(arg.tag) {
+    case kLogArgInt: return arg.i;
+    case kLogArgDouble: return static_cast<int64_t>(arg.d);
+    default: return static_cast<int64_t>(arg.u);
+    }
+}
+
+double asDouble(const LogArg& arg) {
+    switch(arg.tag) {
+    case kLogArgInt: return static_cast<double>(arg.i);
+    case kLogArgDouble: return arg.d;
+    default: return static_cast<double>(arg.u);
+    }
+}
+
+// 以一个转换说明 spec 格式化一个值追加到 out
+template <typename T>
+void appendFormatted(std::string* out, const char* spec, T v) {
+    char buf[128];
+    int n = snprintf(buf, sizeof buf, spec, v);
+    if(n < 0) {
+        return;
+    }
+    if(static_cast<size_t>(n) < sizeof buf) {
+        out->append(buf, n);
+        return;
+    }
+    size_t old = out->size();
+    out->resize(old + n + 1);
+    snprintf(&(*out)[old], n + 1, spec, v);
+    out->resize(old + n);
+}
+
+// 不按转换说明，只按参数类型输出
+void appendDefault(std::string* out, const LogArg& arg) {
+    switch(arg.tag) {
+    case kLogArgInt: appendFormatted(out, "%lld", static_cast<long long>(arg.i)); break;
+    case kLogArgUint: appendFormatted(out, "%llu", static_cast<unsigned long long>(arg.u)); break;
+    case kLogArgDouble: appendFormatted(out, "%g", arg.d); break;
+    case kLogArgPointer: appendFormatted(out, "%p", reinterpret_cast<void*>(arg.u)); break;
+    case kLogArgString: out->append(arg.s, arg.len); break;
+    }
+}
+
+void putU32(std::string* out, uint32_t v) {
+    out->append(reinterpret_cast<const char*>(&v), sizeof v);
+}
+
+void putString(std::string* out, const char* s) {
+    uint32_t len = static_cast<uint32_t>(strlen(s));
+    putU32(out, len);
+    out->append(s, len);
+}
+
+} // namespace
+
+void formatLogArgs(std::string* out, const char* format, const char* args, size_t len) {
+    const char* p = args;
+    const char* end = args + len;
+    const char* f = format;
+    while(*f != '\0') {
+        if(*f != '%') {
+            const char* start = f;
+            while(*f != '\0' && *f != '%') {
+                f++;
+            }
+            out->append(start, f - start);
+            continue;
+        }
+        if(f[1] == '%') {
+            out->push_back('%');
+            f += 2;
+            continue;
+        }
+        // 重新组装转换说明: 保留 flags/width/precision, 长度修饰按参数类型替换
+        char spec[64];
+        size_t n = 0;
+        spec[n++] = '%';
+        const char* s = f + 1;
+        while(*s != '\0' && strchr("-+ #0'", *s) != nullptr && n < 16) {
+            spec[n++] = *s++;
+        }
+        LogArg arg;
+        for(int part = 0; part < 2; part++) {
+            // part 0: width, part 1: precision
+            if(part == 1) {
+                if(*s != '.') {
+                    break;
+                }
+                spec[n++] = *s++;
+            }
+            if(*s == '*') {
+                s++;
+                if(!readArg(p, end, &arg)) {
+                    out->append("<missing>");
+                    return;
+                }
+                n += snprintf(spec + n, sizeof spec - n, "%d", static_cast<int>(asInt(arg)));
+            }
+            else {
+                while(*s >= '0' && *s <= '9' && n < 40) {
+                    spec[n++] = *s++;
+                }
+            }
+        }
+        while(*s != '\0' && strchr("hljztLq", *s) != nullptr) {
+            s++;
+        }
+        const char conv = *s;
+        if(conv == '\0') {
+            out->append(f);
+            return;
+        }
+        f = s + 1;
+        if(!readArg(p, end, &arg)) {
+            out->append("<missing>");
+            continue;
+        }
+        switch(conv) {
+        case 'd': case 'i':
+            spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+            if(arg.tag == kLogArgString) {
+                appendDefault(out, arg);
+            }
+            else {
+                appendFormatted(out, spec, static_cast<long long>(asInt(arg)));
+            }
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+            if(arg.tag == kLogArgString) {
+                appendDefault(out, arg);
+            }
+            else {
+                appendFormatted(out, spec, static_cast<unsigned long long>(asInt(arg)));
+            }
+            break;
+        case 'c':
+            spec[n++] = 'c'; spec[n] = '\0';
+            appendFormatted(out, spec, static_cast<int>(asInt(arg)));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            spec[n++] = conv; spec[n] = '\0';
+            if(arg.tag == kLogArgString) {
+                appendDefault(out, arg);
+            }
+            else {
+                appendFormatted(out, spec, asDouble(arg));
+            }
+            break;
+        case 's':
+            spec[n++] = 's'; spec[n] = '\0';
+            if(arg.tag == kLogArgString) {
+                appendFormatted(out, spec, std::string(arg.s, arg.len).c_str());
+            }
+            else {
+                appendDefault(out, arg);
+            }
+            break;
+        case 'p':
+            appendFormatted(out, "%p", reinterpret_cast<void*>(static_cast<uintptr_t>(asInt(arg))));
+            break;
+        default:
+            appendDefault(out, arg);
+            break;
+        }
+    }
+}
+
+void formatLogRecord(std::string* out, const char* timeStr, int tid, const LogSite& site,
+                     const char* args, size_t len) {
+    char prefix[128];
+    int n = snprintf(prefix, sizeof prefix, "[%s][%d]", timeStr, tid);
+    out->append(prefix, n);
+    out->append(site.levelstr);
+    out->push_back('[');
+    out->append(site.file);
+    n = snprintf(prefix, sizeof prefix, ":%d][", site.line);
+    out->append(prefix, n);
+    out->append(site.function);
+    out->append("]: ");
+    formatLogArgs(out, site.format, args, len);
+    out->push_back('\n');
+}
+
+void appendBinaryLogSite(std::string* out, uint32_t id, const LogSite& site) {
+    out->push_back('S');
+    putU32(out, id);
+    putU32(out, static_cast<uint32_t>(site.line));
+    putString(out, site.levelstr);
+    putString(out, site.file);
+    putString(out, site.function);
+    putString(out, site.format);
+}
+
+void appendBinaryLogEvent(std::string* out, uint32_t id, int64_t time, int tid,
+                          const char* args, size_t len) {
+    out->push_back('E');
+    putU32(out, id);
+    out->append(reinterpret_cast<const char*>(&time), sizeof time);
+    int32_t t = tid;
+    out->append(reinterpret_cast<const char*>(&t), sizeof t);
+    putU32(out, static_cast<uint32_t>(len));
+    out->append(args, len);
+}
+
+void appendBinaryLogText(std::string* out, const char* text, size_t len) {
+    out->push_back('T');
+    putU32(out, static_cast<uint32_t>(len));
+    out->append(text, len);
+}
+
+namespace {
+
+// 解码时持有调用点的字符串
+struct DecodedSite {
+    std::string levelstr;
+    std::string file;
+    std::string function;
+    std::string format;
+    LogSite site;
+};
+
+class Reader {
+public:
+    Reader(const char* p, const char* end): p_(p), end_(end) {}
+    bool done() const { return p_ >= end_; }
+    size_t remaining() const { return end_ - p_; }
+    const char* pos() const { return p_; }
+    bool get(void* v, size_t n) {
+        if(remaining() < n) {
+            return false;
+        }
+        memcpy(v, p_, n);
+        p_ += n;
+        return true;
+    }
+    bool getString(std::string* s) {
+        uint32_t len = 0;
+        if(!get(&len, sizeof len) || remaining() < len) {
+            return false;
+        }
+        s->assign(p_, len);
+        p_ += len;
+        return true;
+    }
+    bool skip(size_t n) {
+        if(remaining() < n) {
+            return false;
+        }
+        p_ += n;
+        return true;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+} // namespace
+
+bool decodeBinaryLog(FILE* in, FILE* out) {
+    std::string data;
+    char buf[65536];
+    size_t n = 0;
+    while((n = fread(buf, 1, sizeof buf, in)) > 0) {
+        data.append(buf, n);
+    }
+    Reader reader(data.data(), data.data() + data.size());
+    std::unordered_map<uint32_t, std::unique_ptr<DecodedSite>> sites;
+    LogTimeFormatter formatter;
+    std::string text;
+    bool sawMagic = false;
+    while(!reader.done()) {
+        const char type = *reader.pos();
+        if(type == kBinaryLogMagic[0]) {
+            // 文件头，拼接的多个文件各自定义调用点
+            if(reader.remaining() < sizeof kBinaryLogMagic
+               || memcmp(reader.pos(), kBinaryLogMagic, sizeof kBinaryLogMagic) != 0) {
+                return false;
+            }
+            reader.skip(sizeof kBinaryLogMagic);
+            sites.clear();
+            sawMagic = true;
+            continue;
+        }
+        if(!sawMagic) {
+            return false;
+        }
+        reader.skip(1);
+        text.clear();
+        if(type == 'S') {
+            std::unique_ptr<DecodedSite> site(new DecodedSite);
+            uint32_t id = 0;
+            uint32_t line = 0;
+            if(!reader.get(&id, sizeof id) || !reader.get(&line, sizeof line)
+               || !reader.getString(&site->levelstr) || !reader.getString(&site->file)
+               || !reader.getString(&site->function) || !reader.getString(&site->format)) {
+                return false;
+            }
+            site->site = LogSite{ site->levelstr.c_str(), site->file.c_str(), static_cast<int>(line),
+                                  site->function.c_str(), site->format.c_str() };
+            sites[id] = std::move(site);
+        }
+        else if(type == 'E') {
+            uint32_t id = 0;
+            int64_t time = 0;
+            int32_t tid = 0;
+            uint32_t len = 0;
+            if(!reader.get(&id, sizeof id) || !reader.get(&time, sizeof time)
+               || !reader.get(&tid, sizeof tid) || !reader.get(&len, sizeof len)
+               || reader.remaining() < len) {
+                return false;
+            }
+            auto it = sites.find(id);
+            if(it == sites.end()) {
+                return false;
+            }
+            char timeStr[LogTimeFormatter::kLength + 1];
+            formatter.format(time, timeStr);
+            formatLogRecord(&text, timeStr, tid, it->second->site, reader.pos(), len);
+            reader.skip(len);
+        }
+        else if(type == 'T') {
+            if(!reader.getString(&text)) {
+                return false;
+            }
+        }
+        else {
+            return false;
+        }
+        fwrite(text.data(), 1, text.size(), out);
+    }
+    return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+// deferred / binary 日志的记录格式
+// 调用线程只把调用点 (LogSite) 的地址、时间和参数的原始值编码进记录，
+// 由后台线程或离线工具 (tools/logdecode) 按格式串格式化
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+/// 一个 log_* 调用点的静态信息，由 log 宏定义为函数内的 static 变量
+struct LogSite {
+    const char* levelstr; // "[INFO ]"
+    const char* file;
+    int line;
+    const char* function;
+    const char* format;   // 用户的格式串，不含 "[文件:行][函数]: " 前缀
+};
+
+/// 参数在记录中的类型标记，之后紧跟值: 整数与指针 8 字节，double 8 字节，
+/// 字符串为 4 字节长度加内容 (不含 '\0')
+enum LogArgTag : char {
+    kLogArgInt = 'i',
+    kLogArgUint = 'u',
+    kLogArgDouble = 'd',
+    kLogArgPointer = 'p',
+    kLogArgString = 's',
+};
+
+/// 把参数编码到调用线程栈上的缓冲区，空间不足时截断字符串或丢弃之后的参数
+class LogArgEncoder {
+public:
+    LogArgEncoder(char* buf, size_t capacity): buf_(buf), capacity_(capacity), size_(0) {}
+
+    size_t size() const { return size_; }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    add(T v) { putScalar(kLogArgInt, static_cast<int64_t>(v)); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+    add(T v) { putScalar(kLogArgUint, static_cast<uint64_t>(v)); }
+
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type
+    add(T v) { putScalar(kLogArgInt, static_cast<int64_t>(v)); }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type
+    add(T v) { putScalar(kLogArgDouble, static_cast<double>(v)); }
+
+    void add(const char* s) { putString(s != nullptr ? s : "(null)"); }
+    void add(char* s) { add(static_cast<const char*>(s)); }
+
+    template <typename T>
+    typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type
+    add(T* p) { putScalar(kLogArgPointer, reinterpret_cast<uint64_t>(p)); }
+
+    void add(std::nullptr_t) { putScalar(kLogArgPointer, uint64_t(0)); }
+
+    void addAll() {}
+    template <typename T, typename... Args>
+    void addAll(const T& first, const Args&... rest) {
+        add(first);
+        addAll(rest...);
+    }
+
+private:
+    template <typename V>
+    void putScalar(char tag, V v) {
+        if(size_ + 1 + sizeof v > capacity_) {
+            return;
+        }
+        buf_[size_] = tag;
+        memcpy(buf_ + size_ + 1, &v, sizeof v);
+        size_ += 1 + sizeof v;
+    }
+
+    void putString(const char* s) {
+        if(size_ + 1 + sizeof(uint32_t) > capacity_) {
+            return;
+        }
+        size_t room = capacity_ - size_ - 1 - sizeof(uint32_t);
+        size_t n = strnlen(s, room);
+        uint32_t len = static_cast<uint32_t>(n);
+        buf_[size_] = kLogArgString;
+        memcpy(buf_ + size_ + 1, &len, sizeof len);
+        memcpy(buf_ + size_ + 1 + sizeof len, s, n);
+        size_ += 1 + sizeof len + n;
+    }
+
+    char* buf_;
+    size_t capacity_;
+    size_t size_;
+};
+
+/// @brief 按 format 格式化编码后的参数，追加到 out；参数类型与转换说明不符时按参数的类型输出
+void formatLogArgs(std::string* out, const char* format, const char* args, size_t len);
+
+/// @brief 格式化一整条日志 "[时间][tid][LEVEL][文件:行][函数]: 消息\n"
+/// timeStr 为已格式化的时间
+void formatLogRecord(std::string* out, const char* timeStr, int tid, const LogSite& site,
+                     const char* args, size_t len);
+
+/// 二进制日志文件: 文件头 kBinaryLogMagic 之后依次为
+///   'S' 调用点定义: u32 id, u32 line, 然后 levelstr, file, function, format 各为 u32 长度加内容
+///   'E' 日志: u32 调用点 id, i64 时间 (us), i32 tid, u32 参数字节数, 参数 (LogArgEncoder 的编码)
+///   'T' 已格式化的文本 (流输出): u32 长度加内容
+/// 每个文件 (包括切换后的新文件) 从文件头开始重新定义用到的调用点
+extern const char kBinaryLogMagic[8];
+
+// 后台线程写二进制日志时使用
+void appendBinaryLogSite(std::string* out, uint32_t id, const LogSite& site);
+void appendBinaryLogEvent(std::string* out, uint32_t id, int64_t time, int tid,
+                          const char* args, size_t len);
+void appendBinaryLogText(std::string* out, const char* text, size_t len);
+
+/// @brief 把二进制日志文件解码为文本写到 out
+/// @return 成功返回 true；文件头不对或记录损坏时返回 false, 已解码的部分已写出
+bool decodeBinaryLog(FILE* in, FILE* out);
@@ -4,3 +4,5 @@
 #include "net.h"
 #include "util.h"
 #include "http/httpserver.h"
+#include "threadpool.h"
+#include "chainbuffer.h"
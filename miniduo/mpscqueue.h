@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <utility> // std::move
+
+namespace miniduo {
+
+/// 无锁多生产者单消费者队列 (Dmitry Vyukov intrusive MPSC queue)
+/// push() 可被任意线程调用，只需一次原子 exchange，没有 CAS 重试；
+/// pop() / empty() 只能由唯一的消费者线程调用
+/// 生产者处于 exchange 与链接 next 之间时，消费者会暂时看不到该元素，
+/// 需要由调用者保证之后还会再 pop 一次 (EventLoop 通过 wakeup 保证)
+/// 节点循环使用: pop 释放的节点回到同一 T 共用的空闲栈，生产者从线程局部缓存取节点，
+/// 稳定状态下 push 不分配内存
+template <class T>
+class MpscQueue {
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+public:
+    MpscQueue()
+        : head_(&stub_),
+          tail_(&stub_)
+    {}
+
+    ~MpscQueue() {
+        T value;
+        while(pop(value)) {}
+        if(tail_ != &stub_) {
+            freeNode(tail_);
+        }
+    }
+
+    // thread safe
+    void push(T&& value) {
+        Node* node = allocNode();
+        node->value = std::move(value);
+        link(node);
+    }
+    // thread safe
+    void push(const T& value) {
+        Node* node = allocNode();
+        node->value = value;
+        link(node);
+    }
+
+    /// Not thread safe, called by the consumer
+    /// @return 队列为空时返回 false
+    bool pop(T& value) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if(next == nullptr) {
+            return false;
+        }
+        // next 成为新的哨兵节点，其中的值已被移出
+        value = std::move(next->value);
+        tail_ = next;
+        if(tail != &stub_) {
+            freeNode(tail);
+        }
+        return true;
+    }
+
+    /// Not thread safe, called by the consumer
+    bool empty() const {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        Node(): next(nullptr) {}
+        std::atomic<Node*> next;
+        T value; // 空闲节点中是已被移出的值，复用时赋值覆盖
+    };
+
+    // 共享空闲栈最多保存的节点数，超过时直接释放
+    static const size_t kMaxFreeNodes = 4096;
+
+    // 消费者逐个压入 (CAS)，生产者用 exchange 整个取走，不逐个弹出，没有 ABA 问题
+    struct FreeNodes {
+        FreeNodes(): head(nullptr), count(0) {}
+        std::atomic<Node*> head;
+        std::atomic<size_t> count; // 近似值，只用于限制数量
+    };
+
+    // 生产者线程的节点缓存，线程退出时释放
+    struct LocalNodes {
+        LocalNodes(): head(nullptr) {}
+        ~LocalNodes() {
+            while(head != nullptr) {
+                Node* node = head;
+                head = node->next.load(std::memory_order_relaxed);
+                delete node;
+            }
+        }
+        Node* head;
+    };
+
+    static FreeNodes& freeNodes() {
+        // 不析构: 静态对象析构之后仍可能有队列析构并释放节点
+        static FreeNodes* nodes = new FreeNodes;
+        return *nodes;
+    }
+
+    static Node* allocNode() {
+        static thread_local LocalNodes local;
+        if(local.head == nullptr) {
+            FreeNodes& shared = freeNodes();
+            if(shared.head.load(std::memory_order_relaxed) != nullptr) {
+                local.head = shared.head.exchange(nullptr, std::memory_order_acquire);
+                size_t n = 0;
+                for(Node* node = local.head; node != nullptr;
+                    node = node->next.load(std::memory_order_relaxed)) {
+                    n++;
+                }
+                shared.count.fetch_sub(n, std::memory_order_relaxed);
+            }
+        }
+        Node* node = local.head;
+        if(node == nullptr) {
+            return new Node;
+        }
+        local.head = node->next.load(std::memory_order_relaxed);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        return node;
+    }
+
+    static void freeNode(Node* node) {
+        FreeNodes& shared = freeNodes();
+        if(shared.count.load(std::memory_order_relaxed) >= kMaxFreeNodes) {
+            delete node;
+            return;
+        }
+        // 先计数再压入，取走时减去的数量不会超过已加上的
+        shared.count.fetch_add(1, std::memory_order_relaxed);
+        Node* head = shared.head.load(std::memory_order_relaxed);
+        do {
+            node->next.store(head, std::memory_order_relaxed);
+        } while(!shared.head.compare_exchange_weak(head, node, std::memory_order_release,
+                                                   std::memory_order_relaxed));
+    }
+
+    void link(Node* node) {
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    Node stub_;
+    std::atomic<Node*> head_; // 生产者端，最新 push 的节点
+    Node* tail_;              // 消费者端，哨兵节点
+
+}; // class MpscQueue
+
+} // namespace miniduo
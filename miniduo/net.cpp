@@ -8,6 +8,9 @@
 #include <cassert>
 #include <unistd.h> // close()
 
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::NET
+
 
 namespace miniduo {
 namespace socket {
@@ -25,6 +28,47 @@ void setReuseAddr(int sockfd, bool value) {
     assert(ret >= 0);
 }
 
+void setReusePort(int sockfd, bool value) {
+    int optval = value ? 1 : 0;
+    int ret = setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT,
+                &optval, sizeof(optval));
+    assert(ret >= 0);
+}
+
+bool setBusyPoll(int sockfd, int usec) {
+    int ret = setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL,
+                &usec, sizeof(usec));
+    if(ret < 0) {
+        log_error("setBusyPoll(%d, %d)", sockfd, usec);
+        return false;
+    }
+    return true;
+}
+
+bool setZeroCopy(int sockfd, bool value) {
+    int optval = value ? 1 : 0;
+    int ret = setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY,
+                &optval, sizeof(optval));
+    if(ret < 0) {
+        log_error("setZeroCopy(%d, %d)", sockfd, optval);
+        return false;
+    }
+    return true;
+}
+
+bool setLinger(int sockfd, bool on, int seconds) {
+    struct linger optval;
+    optval.l_onoff = on ? 1 : 0;
+    optval.l_linger = seconds;
+    int ret = setsockopt(sockfd, SOL_SOCKET, SO_LINGER,
+                &optval, sizeof(optval));
+    if(ret < 0) {
+        log_error("setLinger(%d, %d, %d)", sockfd, optval.l_onoff, seconds);
+        return false;
+    }
+    return true;
+}
+
 void bindAddr(int sockfd, const SockAddr& addr) {
     int ret = bind(sockfd, (struct sockaddr *) &addr.getSockAddr(), 
                     sizeof(struct sockaddr));
@@ -41,7 +85,9 @@ int acceptSock(int sockfd, SockAddr* peerAddr) {
     struct sockaddr_in paddr;
     socklen_t alen = sizeof(paddr);
     bzero(&paddr, sizeof(paddr));
-    int connfd = accept(sockfd, (struct sockaddr *) &paddr, &alen );
+    // 连接 socket 必须是非阻塞的，否则 edge-triggered 的读写循环会阻塞在最后一次读写
+    int connfd = ::accept4(sockfd, (struct sockaddr *) &paddr, &alen,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
     // assert(connfd >= 0);
     if(connfd >= 0){
         peerAddr->setSockAddr(paddr);
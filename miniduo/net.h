@@ -12,6 +12,14 @@ namespace socket {
 
 extern int createNonblockingSock();
 extern void setReuseAddr(int sockfd, bool value = true); // ???
+// SO_REUSEPORT, 多个 socket 绑定同一端口，由内核在其间分发新连接
+extern void setReusePort(int sockfd, bool value = true);
+// SO_BUSY_POLL, 阻塞读时在网卡队列上忙等 usec 微秒; 超过系统默认值需要 CAP_NET_ADMIN
+extern bool setBusyPoll(int sockfd, int usec);
+// SO_ZEROCOPY, 允许 send 使用 MSG_ZEROCOPY; 内核 4.14 之前不支持
+extern bool setZeroCopy(int sockfd, bool value = true);
+// SO_LINGER; on 且 seconds 为 0 时 close 发送 RST 并丢弃发送队列中的数据
+extern bool setLinger(int sockfd, bool on, int seconds);
 extern void bindAddr(int sockfd, const SockAddr& addr);
 extern void listenSock(int sockfd);
 extern int acceptSock(int sockfd, SockAddr* peerAddr);
@@ -6,6 +6,15 @@
 #include <cassert>
 #include <unistd.h>
 #include <cstring> // memset()
+#include <cstdlib> // getenv()
+#include <sys/mman.h> // mmap()
+#include <sys/syscall.h> // __NR_io_uring_*
+#include <sys/socket.h> // MSG_NOSIGNAL
+#include <linux/io_uring.h> // struct io_uring_sqe
+
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::NET
+
 // #include <pair>
 
 using namespace miniduo;
@@ -18,6 +27,16 @@ void BasePoller::assertInLoop() const {
     loop_->assertInLoopThread();
 }
 
+BasePoller* BasePoller::newDefaultPoller(EventLoop* loop) {
+    if(::getenv("MINIDUO_USE_POLL")) {
+        return new PollPoller(loop);
+    }
+    if(!::getenv("MINIDUO_USE_EPOLL") && IoUringPoller::supported()) {
+        return new IoUringPoller(loop);
+    }
+    return new EPollPoller(loop);
+}
+
 PollPoller::~PollPoller() {
     log_trace("PollPoller is destroyed");
 }
@@ -52,9 +71,9 @@ void PollPoller::fillActiveChannels(int numEvents,
         // 该 fd 有活动事件
         if(pfd->revents > 0) {
             --numEvents;
-            ChannelMap::const_iterator ch = channels_.find(pfd->fd);
-            assert(ch != channels_.end());
-            Channel* channel = ch->second.first;
+            const std::pair<Channel*, int>* ch = channels_.find(pfd->fd);
+            assert(ch != nullptr);
+            Channel* channel = ch->first;
             assert(channel->fd() == pfd->fd);
             channel->setRevents(pfd->revents); // 激活 channel 的活动事件
             // pfd->revents = 0;
@@ -66,22 +85,24 @@ void PollPoller::fillActiveChannels(int numEvents,
 void PollPoller::addChannel(Channel* channel) {
     assertInLoop();
     log_trace("PollPoller add: fd = %d, interested events = %d", channel->fd(), channel->events());
-    assert(channels_.find(channel->fd()) == channels_.end());
     struct pollfd pfd;
     pfd.fd = channel->isNoneEvent() ? -channel->fd()-1 : channel->fd();
     pfd.events = static_cast<short>(channel->events());
     pfd.revents = 0;
-    channels_[channel->fd()] = {channel, pollfds_.size()};
+    bool inserted = channels_.insert(channel->fd(), {channel, static_cast<int>(pollfds_.size())});
+    assert(inserted);
+    (void) inserted;
     pollfds_.push_back(pfd);
 }
 
 void PollPoller::updateChannel(Channel* channel) {
     assertInLoop();
     log_trace("PollPoller update: fd = %d, interested events = %d", channel->fd(), channel->events());
-    assert(channels_.find(channel->fd()) != channels_.end() );
-    assert(channels_[channel->fd()].first == channel);
-    int idx = channels_[channel->fd()].second;
-    assert(idx >= 0 && idx < pollfds_.size());
+    const std::pair<Channel*, int>* ch = channels_.find(channel->fd());
+    assert(ch != nullptr);
+    assert(ch->first == channel);
+    int idx = ch->second;
+    assert(idx >= 0 && static_cast<size_t>(idx) < pollfds_.size());
     struct pollfd& pfd = pollfds_[idx];
     assert(pfd.fd == channel->fd() || pfd.fd == -channel->fd()-1);
     pfd.events = static_cast<short>(channel->events());
@@ -96,12 +117,12 @@ void PollPoller::updateChannel(Channel* channel) {
 void PollPoller::removeChannel(Channel* channel) {
     assertInLoop();
     log_trace("PollPoller remove: fd = %d", channel->fd());
-    assert(channels_.find(channel->fd()) != channels_.end());
-    assert(channels_[channel->fd()].first == channel);
+    const std::pair<Channel*, int>* ch = channels_.find(channel->fd());
+    assert(ch != nullptr);
+    assert(ch->first == channel);
     assert(channel->isNoneEvent());
-    int idx = channels_[channel->fd()].second;
-    assert(0 <= idx && idx < pollfds_.size());
-    const struct pollfd& pfd = pollfds_[idx];
+    int idx = ch->second;
+    assert(0 <= idx && static_cast<size_t>(idx) < pollfds_.size());
     size_t n = channels_.erase(channel->fd());
     assert(n == 1); // 断言成功删除，失败的话 n == 0
     if(static_cast<size_t>(idx) < pollfds_.size()-1) {
@@ -112,7 +133,7 @@ void PollPoller::removeChannel(Channel* channel) {
             endfd = - endfd - 1;
         }
         // 重置 endfd 的索引
-        channels_[endfd].second = idx;
+        channels_.find(endfd)->second = idx;
     }
     pollfds_.pop_back();
 }
@@ -167,9 +188,9 @@ void EPollPoller::fillActiveChannels(int numEvents,
         Channel* channel = static_cast<Channel*> (events_[i].data.ptr);
 #ifndef NDEBUG
         const int fd = channel->fd();
-        ChannelMap::const_iterator it = channels_.find(fd);
-        assert(it != channels_.end());
-        assert(it->second.first == channel);
+        const std::pair<Channel*, ChannelState>* ch = channels_.find(fd);
+        assert(ch != nullptr);
+        assert(ch->first == channel);
 #endif
         channel->setRevents(events_[i].events);
         activeChannels->push_back(channel);
@@ -180,8 +201,9 @@ void EPollPoller::addChannel(Channel* channel) {
     assertInLoop();
     const int fd = channel->fd();
     log_trace("fd = %d", fd);
-    assert(channels_.find(fd) == channels_.end());
-    channels_[fd] = {channel, ChannelState::NEW};
+    bool inserted = channels_.insert(fd, {channel, ChannelState::NEW});
+    assert(inserted);
+    (void) inserted;
     updateChannel(channel); 
 }
 
@@ -189,22 +211,23 @@ void EPollPoller::updateChannel(Channel* channel) {
     assertInLoop();
     const int fd = channel->fd();
     log_trace("fd = %d", fd);
-    assert(channels_.find(fd) != channels_.end());
-    assert(channels_[fd].first == channel);
-    if(channels_[fd].second == ChannelState::NEW 
-       || channels_[fd].second == ChannelState::DELETED) 
+    std::pair<Channel*, ChannelState>* ch = channels_.find(fd);
+    assert(ch != nullptr);
+    assert(ch->first == channel);
+    if(ch->second == ChannelState::NEW 
+       || ch->second == ChannelState::DELETED) 
     {
         if(!channel->isNoneEvent()) {
-            channels_[fd].second = ChannelState::ADDED;
+            ch->second = ChannelState::ADDED;
             update(EPOLL_CTL_ADD, channel);
         }
     }
-    else { // if channels_[fd].second == ChannelState::ADDED
+    else { // if ch->second == ChannelState::ADDED
         if(!channel->isNoneEvent()) {
             update(EPOLL_CTL_MOD, channel);
         }
         else {
-            channels_[fd].second = ChannelState::DELETED;
+            ch->second = ChannelState::DELETED;
             update(EPOLL_CTL_DEL, channel);
         }
     }
@@ -216,10 +239,11 @@ void EPollPoller::removeChannel(Channel* channel) {
     assertInLoop();
     const int fd = channel->fd();
     log_trace("fd = %d", fd);
-    assert(channels_.find(fd) != channels_.end());
-    assert(channels_[fd].first == channel);
+    const std::pair<Channel*, ChannelState>* ch = channels_.find(fd);
+    assert(ch != nullptr);
+    assert(ch->first == channel);
     assert(channel->isNoneEvent());
-    if(channels_[fd].second == ChannelState::ADDED) {
+    if(ch->second == ChannelState::ADDED) {
         update(EPOLL_CTL_DEL, channel);
     }
     size_t n = channels_.erase(fd);
@@ -239,4 +263,364 @@ void EPollPoller::update(int operation, Channel* channel) {
         ///  FIXME: 错误处理
         log_fatal("EPollPoller::update: epoll_ctl ");
     }
-}
\ No newline at end of file
+}
+
+
+namespace miniduo {
+// io_uring helper functions, 系统未提供 liburing，直接使用系统调用
+int ioUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ringfd, unsigned toSubmit, unsigned minComplete,
+                 unsigned flags, const void* arg, size_t argSize)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringfd, toSubmit,
+                                      minComplete, flags, arg, argSize));
+}
+
+} // namespace miniduo
+
+
+bool IoUringPoller::supported() {
+    static const bool isSupported = [] {
+        struct io_uring_params params;
+        ::memset(&params, 0, sizeof params);
+        int fd = ioUringSetup(4, &params);
+        if(fd < 0) {
+            return false;
+        }
+        ::close(fd);
+        // EXT_ARG: io_uring_enter 带超时等待; NODROP: cq 溢出不丢事件
+        const unsigned required = IORING_FEAT_SINGLE_MMAP
+                                | IORING_FEAT_NODROP
+                                | IORING_FEAT_EXT_ARG;
+        return (params.features & required) == required;
+    }();
+    return isSupported;
+}
+
+IoUringPoller::IoUringPoller(EventLoop* loop)
+    : BasePoller(loop),
+      ringfd_(-1),
+      pendingSubmit_(0),
+      pollGen_(0),
+      ringPtr_(MAP_FAILED),
+      ringSize_(0),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqesSize_(0)
+{
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof params);
+    // cq 设为 sq 的 4 倍，一轮 poll 中 completion 远多于一次提交的 sqe
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kRingEntries * 4;
+    ringfd_ = ioUringSetup(kRingEntries, &params);
+    exit_if(ringfd_ < 0, "IoUringPoller::IoUringPoller io_uring_setup");
+    assert(params.features & IORING_FEAT_SINGLE_MMAP);
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ringSize_ = std::max(sqSize, cqSize);
+    ringPtr_ = ::mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+    exit_if(ringPtr_ == MAP_FAILED, "IoUringPoller::IoUringPoller mmap ring");
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQES);
+    exit_if(sqes == MAP_FAILED, "IoUringPoller::IoUringPoller mmap sqes");
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* ring = static_cast<char*>(ringPtr_);
+    sqHead_ = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+    cqHead_ = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(ring + params.cq_off.cqes);
+    log_trace("IoUringPoller created: sq entries %u, cq entries %u",
+              params.sq_entries, params.cq_entries);
+}
+
+IoUringPoller::~IoUringPoller() {
+    if(sqes_ != MAP_FAILED) {
+        ::munmap(sqes_, sqesSize_);
+    }
+    if(ringPtr_ != MAP_FAILED) {
+        ::munmap(ringPtr_, ringSize_);
+    }
+    if(ringfd_ >= 0) {
+        ::close(ringfd_);
+    }
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels) {
+    log_trace("fd total count: %d", channels_.size());
+    // 重新 arm 上一轮触发过的 channel
+    for(int fd: rearmList_) {
+        ChannelEntry* entry = channels_.find(fd);
+        if(entry != nullptr && !entry->armed && !entry->channel->isNoneEvent()) {
+            armPoll(fd, *entry);
+        }
+    }
+    rearmList_.clear();
+
+    int ret = submitAndWait(timeoutMs);
+    int saveErrno = errno;
+    Timestamp now = util::getTimeOfNow();
+    if(ret < 0 && saveErrno != ETIME && saveErrno != EINTR) {
+        errno = saveErrno;
+        log_error("IoUringPoller::poll");
+    }
+    size_t before = activeChannels->size();
+    fillActiveChannels(activeChannels);
+    if(activeChannels->size() > before || !completions_.empty()) {
+        log_trace("%d events happened, %d completions",
+                  activeChannels->size() - before, completions_.size());
+    }
+    else {
+        log_trace("nothing happened");
+    }
+    return now;
+}
+
+void IoUringPoller::fillActiveChannels(ChannelList* activeChannels) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    const unsigned mask = *cqMask_;
+    for(; head != tail; ++head) {
+        const struct io_uring_cqe& cqe = cqes_[head & mask];
+        if(cqe.user_data == 0) {
+            continue; // POLL_REMOVE / ASYNC_CANCEL 的 completion
+        }
+        if(cqe.user_data & kOpFlag) {
+            completeOp(cqe.user_data, cqe.res);
+            continue;
+        }
+        const int fd = static_cast<int>(cqe.user_data >> 32);
+        const uint32_t gen = static_cast<uint32_t>(cqe.user_data);
+        ChannelEntry* entry = channels_.find(fd);
+        if(entry == nullptr || !entry->armed || entry->gen != gen) {
+            continue; // 已被移除或重新 arm 的过期 completion
+        }
+        entry->armed = false;
+        rearmList_.push_back(fd);
+        entry->channel->setRevents(cqe.res >= 0 ? cqe.res : POLLERR);
+        activeChannels->push_back(entry->channel);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::addChannel(Channel* channel) {
+    assertInLoop();
+    const int fd = channel->fd();
+    log_trace("fd = %d", fd);
+    bool inserted = channels_.insert(fd, {channel, false, 0, 0});
+    assert(inserted);
+    (void) inserted;
+    updateChannel(channel);
+}
+
+void IoUringPoller::updateChannel(Channel* channel) {
+    assertInLoop();
+    const int fd = channel->fd();
+    log_trace("fd = %d", fd);
+    ChannelEntry* found = channels_.find(fd);
+    assert(found != nullptr);
+    ChannelEntry& entry = *found;
+    assert(entry.channel == channel);
+    const uint32_t events = static_cast<uint32_t>(channel->events());
+    if(entry.armed) {
+        if(!channel->isNoneEvent() && entry.armedEvents == events) {
+            return;
+        }
+        disarmPoll(entry, fd);
+    }
+    if(!channel->isNoneEvent()) {
+        armPoll(fd, entry);
+    }
+}
+
+void IoUringPoller::removeChannel(Channel* channel) {
+    assertInLoop();
+    const int fd = channel->fd();
+    log_trace("fd = %d", fd);
+    ChannelEntry* entry = channels_.find(fd);
+    assert(entry != nullptr);
+    assert(entry->channel == channel);
+    assert(channel->isNoneEvent());
+    if(entry->armed) {
+        disarmPoll(*entry, fd);
+    }
+    channels_.erase(fd);
+}
+
+struct io_uring_sqe* IoUringPoller::getSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail_;
+    if(tail - head >= sqEntries_) {
+        // ring 已满，先提交已有的 sqe
+        int ret = ioUringEnter(ringfd_, pendingSubmit_, 0, 0, nullptr, 0);
+        if(ret < 0) {
+            log_error("IoUringPoller::getSqe io_uring_enter");
+        }
+        else {
+            pendingSubmit_ -= ret;
+        }
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        exit_if(tail - head >= sqEntries_, "IoUringPoller::getSqe submission ring is full");
+    }
+    const unsigned idx = tail & *sqMask_;
+    struct io_uring_sqe* sqe = &sqes_[idx];
+    ::memset(sqe, 0, sizeof *sqe);
+    sqArray_[idx] = idx;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++pendingSubmit_;
+    return sqe;
+}
+
+void IoUringPoller::armPoll(int fd, ChannelEntry& entry) {
+    assert(!entry.armed);
+    // 代数取自整个 poller 的计数器而不是表项: fd 关闭后被新 channel 复用时，
+    // 旧 channel 未收割的 completion 不会与新 channel 的第一次 arm 同号
+    if(++pollGen_ == 0) {
+        pollGen_ = 1; // user_data == 0 留给 POLL_REMOVE
+    }
+    entry.gen = pollGen_;
+    entry.armed = true;
+    entry.armedEvents = static_cast<uint32_t>(entry.channel->events());
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = entry.armedEvents;
+    sqe->user_data = (static_cast<uint64_t>(fd) << 32) | entry.gen;
+    log_trace("io_uring poll_add: fd = %d, events = %u", fd, entry.armedEvents);
+}
+
+void IoUringPoller::disarmPoll(ChannelEntry& entry, int fd) {
+    assert(entry.armed);
+    entry.armed = false;
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = (static_cast<uint64_t>(fd) << 32) | entry.gen;
+    sqe->user_data = 0;
+    log_trace("io_uring poll_remove: fd = %d", fd);
+}
+
+int IoUringPoller::submitAndWait(int timeoutMs) {
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+    struct io_uring_getevents_arg arg;
+    ::memset(&arg, 0, sizeof arg);
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    int ret = ioUringEnter(ringfd_, pendingSubmit_, timeoutMs == 0 ? 0 : 1,
+                           flags, &arg, sizeof arg);
+    if(ret >= 0) {
+        pendingSubmit_ -= ret;
+    }
+    else if(errno == EBUSY || errno == EAGAIN) {
+        // completion 积压，先收割后续再提交
+        ret = 0;
+    }
+    return ret;
+}
+
+IoUringPoller::OpId IoUringPoller::submitRecv(int fd, void* buf, size_t len,
+                                              CompletionCallback cb)
+{
+    assertInLoop();
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+    return allocOp(sqe, std::move(cb));
+}
+
+IoUringPoller::OpId IoUringPoller::submitSend(int fd, const void* buf, size_t len,
+                                              CompletionCallback cb)
+{
+    assertInLoop();
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    return allocOp(sqe, std::move(cb));
+}
+
+IoUringPoller::OpId IoUringPoller::submitPoll(int fd, uint32_t events,
+                                              CompletionCallback cb)
+{
+    assertInLoop();
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    return allocOp(sqe, std::move(cb));
+}
+
+void IoUringPoller::cancelOp(OpId id) {
+    assertInLoop();
+    assert(id & kOpFlag);
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = id;
+    sqe->user_data = 0;
+}
+
+IoUringPoller::OpId IoUringPoller::allocOp(struct io_uring_sqe* sqe,
+                                           CompletionCallback cb)
+{
+    uint32_t slot;
+    if(!freeOps_.empty()) {
+        slot = freeOps_.back();
+        freeOps_.pop_back();
+    }
+    else {
+        slot = static_cast<uint32_t>(ops_.size());
+        ops_.push_back({CompletionCallback(), 0, false});
+    }
+    OpSlot& op = ops_[slot];
+    assert(!op.inUse);
+    op.callback = std::move(cb);
+    op.inUse = true;
+    // gen 只占 31 位，最高位为 kOpFlag
+    op.gen = (op.gen + 1) & 0x7fffffff;
+    OpId id = kOpFlag | (static_cast<uint64_t>(op.gen) << 32) | slot;
+    sqe->user_data = id;
+    return id;
+}
+
+void IoUringPoller::completeOp(uint64_t userData, int res) {
+    const uint32_t slot = static_cast<uint32_t>(userData);
+    const uint32_t gen = static_cast<uint32_t>(userData >> 32) & 0x7fffffff;
+    assert(slot < ops_.size());
+    OpSlot& op = ops_[slot];
+    if(!op.inUse || op.gen != gen) {
+        return;
+    }
+    op.inUse = false;
+    completions_.push_back({std::move(op.callback), res});
+    op.callback = nullptr;
+    freeOps_.push_back(slot);
+}
+
+void IoUringPoller::dispatchCompletions(Timestamp recvTime) {
+    if(completions_.empty()) {
+        return;
+    }
+    CompletionList completions;
+    completions.swap(completions_);
+    for(auto& completion: completions) {
+        completion.first(completion.second, recvTime);
+    }
+}
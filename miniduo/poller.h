@@ -4,16 +4,73 @@
 
 
 #include <vector>
-#include <map>
+#include <algorithm> // std::max()
+#include <cassert>
+#include <functional> // std::function<>
 #include <poll.h> // struct pollfd
 #include <sys/epoll.h> // struct epoll_event
 
 
+struct io_uring_sqe;
+struct io_uring_cqe;
+
 namespace miniduo {
 
 class Channel;
 class EventLoop;
 
+/// fd 为下标的稠密表，按需增长，替代 std::map<int, T>
+/// fd 由内核从小到大分配，表的大小与最大 fd 同阶
+template <class T>
+class FdTable {
+public:
+    FdTable(): size_(0) {}
+
+    T* find(int fd) {
+        if(fd < 0 || static_cast<size_t>(fd) >= slots_.size() || !slots_[fd].used) {
+            return nullptr;
+        }
+        return &slots_[fd].value;
+    }
+    const T* find(int fd) const {
+        return const_cast<FdTable*>(this)->find(fd);
+    }
+    // fd 已存在时返回 false
+    bool insert(int fd, const T& value) {
+        assert(fd >= 0);
+        if(static_cast<size_t>(fd) >= slots_.size()) {
+            slots_.resize(std::max(static_cast<size_t>(fd) + 1, slots_.size() * 2));
+        }
+        Slot& slot = slots_[fd];
+        if(slot.used) {
+            return false;
+        }
+        slot.value = value;
+        slot.used = true;
+        ++size_;
+        return true;
+    }
+    // 返回删除的元素个数
+    size_t erase(int fd) {
+        if(find(fd) == nullptr) {
+            return 0;
+        }
+        slots_[fd].used = false;
+        --size_;
+        return 1;
+    }
+    size_t size() const { return size_; }
+
+private:
+    struct Slot {
+        T value = T();
+        bool used = false;
+    };
+    std::vector<Slot> slots_;
+    size_t size_;
+
+}; // class FdTable
+
 class BasePoller {
     BasePoller(const BasePoller&) = delete;
     BasePoller& operator=(const BasePoller&) = delete;
@@ -26,7 +83,17 @@ public:
     virtual void addChannel(Channel* channel) = 0;
     virtual void removeChannel(Channel* channel) = 0;
     virtual void updateChannel(Channel *channel) = 0;
+    /// @brief 执行 poll() 中收割到的完成事件回调，由 EventLoop 在处理完 IO 事件后调用
+    virtual void dispatchCompletions(Timestamp /*recvTime*/) {}
+    /// @brief 上一次 poll() 是否收割到尚未执行的完成事件
+    virtual bool hasPendingCompletions() const { return false; }
+    /// @brief 是否支持 Channel::setEdgeTriggered()
+    virtual bool supportsEdgeTriggered() const { return false; }
     void assertInLoop() const ;
+
+    /// @brief 按内核支持情况选择 poller: io_uring > epoll
+    /// 环境变量 MINIDUO_USE_POLL / MINIDUO_USE_EPOLL 可强制指定
+    static BasePoller* newDefaultPoller(EventLoop* loop);
     
 private:
     EventLoop* loop_;
@@ -48,7 +115,7 @@ public:
 private:
     typedef std::vector<struct pollfd> PollfdList;
     // fd-> {Channel*, index in pollfds_}
-    typedef std::map<int, std::pair<Channel*, int>> ChannelMap;
+    typedef FdTable<std::pair<Channel*, int>> ChannelMap;
 
     void fillActiveChannels(int numEvents, ChannelList* activeChannels) const;
 
@@ -67,6 +134,7 @@ public:
     void updateChannel(Channel* channel) override;
     void addChannel(Channel* channel) override;
     void removeChannel(Channel* channel) override;
+    bool supportsEdgeTriggered() const override { return true; }
 
 private:
     static const int kInitEventListSize = 16;
@@ -80,7 +148,7 @@ private:
         DELETED
     };
     typedef std::vector<struct epoll_event> EventList;
-    typedef std::map<int, std::pair<Channel*, ChannelState>> ChannelMap;
+    typedef FdTable<std::pair<Channel*, ChannelState>> ChannelMap;
 
     int epollfd_;
     EventList events_;
@@ -89,4 +157,94 @@ private:
 }; // class EPollPoller
 
 
+/// 基于 io_uring IORING_OP_POLL_ADD 的 poller
+/// poll 注册为 one-shot，触发后在下一次 poll() 中重新 arm，以模拟 level-triggered 语义；
+/// 同一轮循环中的注册、修改、重新 arm 都只写入 submission ring，
+/// 在 poll() 中与等待事件合并为一次 io_uring_enter(2)
+class IoUringPoller: public BasePoller {
+public:
+    IoUringPoller(EventLoop* loop);
+    ~IoUringPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
+    void updateChannel(Channel* channel) override;
+    void addChannel(Channel* channel) override;
+    void removeChannel(Channel* channel) override;
+
+    /// @brief 探测内核是否提供本 poller 需要的 io_uring 特性
+    static bool supported();
+
+    // completion-based 操作，回调参数为 cqe.res 及本轮 poll 的返回时间
+    // 回调在 dispatchCompletions() 中执行，被 cancel 的操作回调 -ECANCELED
+    // 缓冲区需保持有效直到回调被执行
+    typedef std::function<void(int res, Timestamp recvTime)> CompletionCallback;
+    typedef uint64_t OpId;
+    /// Not thread safe, called in loop
+    OpId submitRecv(int fd, void* buf, size_t len, CompletionCallback cb);
+    /// Not thread safe, called in loop
+    OpId submitSend(int fd, const void* buf, size_t len, CompletionCallback cb);
+    /// @brief 提交一次 one-shot poll，等待 fd 上出现 events
+    OpId submitPoll(int fd, uint32_t events, CompletionCallback cb);
+    /// @brief 取消一个未完成的操作，已完成的操作忽略
+    void cancelOp(OpId id);
+    void dispatchCompletions(Timestamp recvTime) override;
+    bool hasPendingCompletions() const override { return !completions_.empty(); }
+
+private:
+    static const unsigned kRingEntries = 256;
+    static const OpId kOpFlag = 1ULL << 63; // 区分 channel poll 与 completion 操作
+
+    struct OpSlot {
+        CompletionCallback callback;
+        uint32_t gen;
+        bool inUse;
+    };
+    typedef std::vector<std::pair<CompletionCallback, int>> CompletionList;
+
+    struct ChannelEntry {
+        Channel* channel;
+        bool armed;           // 是否有未完成的 POLL_ADD
+        uint32_t armedEvents; // 已 arm 的事件
+        uint32_t gen;         // 当前 arm 的代数 (取自 pollGen_)，用于丢弃过期的 completion
+    };
+    typedef FdTable<ChannelEntry> ChannelMap;
+
+    // 取得一个空闲的 sqe，ring 满时先提交已有的 sqe
+    struct io_uring_sqe* getSqe();
+    void armPoll(int fd, ChannelEntry& entry);
+    void disarmPoll(ChannelEntry& entry, int fd);
+    // 分配一个操作槽位并填写 sqe 的 user_data
+    OpId allocOp(struct io_uring_sqe* sqe, CompletionCallback cb);
+    void completeOp(uint64_t userData, int res);
+    // 提交所有 pending sqe，并最多等待 timeoutMs 直到至少一个 completion
+    int submitAndWait(int timeoutMs);
+    void fillActiveChannels(ChannelList* activeChannels);
+
+    int ringfd_;
+    unsigned pendingSubmit_;  // 已写入 ring 尚未提交的 sqe 数量
+    uint32_t pollGen_;        // 最近一次 POLL_ADD 的代数，不随 channel 的移除而重置
+
+    void* ringPtr_;
+    size_t ringSize_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqMask_;
+    unsigned* sqArray_;
+    unsigned sqEntries_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqMask_;
+    struct io_uring_cqe* cqes_;
+
+    ChannelMap channels_;
+    std::vector<int> rearmList_; // 已触发、待重新 arm 的 fd
+    std::vector<OpSlot> ops_;
+    std::vector<uint32_t> freeOps_;
+    CompletionList completions_; // 本轮 poll 收割到的完成事件
+
+}; // class IoUringPoller
+
+
 } // namespace miniduo
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory> // std::shared_ptr<T>
+#include <string>
+#include <utility> // std::move
+
+namespace miniduo
+{
+
+/// 不可变的共享发送数据，同一份数据可发给多个连接 (广播)，见 TcpConnection::send(const PayloadPtr&)
+typedef std::string Payload;
+typedef std::shared_ptr<const Payload> PayloadPtr;
+
+/// TcpConnection::sendv() 的待发送数据片段，不拷贝到 output buffer，由 writev(2) 直接发送
+/// - 自有: 移入的 std::string，由连接持有到发送完成
+/// - 借用: 调用者保证数据在 writeCompleteCallback 之前有效 (zerocopy 发送时回调在内核通知
+///   发送完成之后)，连接在此之前关闭时保证到连接析构
+/// - 共享: 持有不可变数据的引用计数直到发送完成，同一份数据可发给多个连接
+class Slice {
+public:
+    explicit Slice(std::string&& str)
+        : owned_(std::move(str)), borrowed_(nullptr), len_(owned_.size()), offset_(0)
+    {}
+    Slice(const void* data, size_t len)
+        : borrowed_(static_cast<const char*>(data)), len_(len), offset_(0)
+    {}
+    explicit Slice(PayloadPtr blob)
+        : shared_(std::move(blob)), borrowed_(nullptr),
+          len_(shared_ ? shared_->size() : 0), offset_(0)
+    {}
+
+    // 未发送部分的起始地址
+    const char* data() const { return base() + offset_; }
+    // 未发送部分的长度
+    size_t size() const { return len_ - offset_; }
+    // 已发送 n 字节
+    void consume(size_t n) { offset_ += n; }
+
+private:
+    // owned_ 移动后地址会变 (SSO)，因此每次重新计算
+    const char* base() const {
+        return shared_ ? shared_->data() : borrowed_ ? borrowed_ : owned_.data();
+    }
+
+    std::string owned_;
+    PayloadPtr shared_;
+    const char* borrowed_;
+    size_t len_;
+    size_t offset_;
+
+}; // class Slice
+
+} // namespace miniduo
@@ -0,0 +1,163 @@
+#include "threadpool.h"
+#include "logging.h"
+
+#include <cassert>
+
+using namespace miniduo;
+
+namespace {
+// 当前线程所属的线程池及 worker 序号，用于 worker 内部提交到本地队列
+thread_local ComputePool* t_pool = nullptr;
+thread_local int t_workerIndex = -1;
+} // namespace
+
+ComputePool::ComputePool(int numThreads)
+    : next_(0),
+      pending_(0),
+      sleepers_(0),
+      running_(false),
+      executed_(0),
+      stolen_(0)
+{
+    if(numThreads <= 0) {
+        numThreads = 1;
+    }
+    for(int i=0; i<numThreads; i++) {
+        workers_.emplace_back(new Worker);
+    }
+}
+
+ComputePool::~ComputePool() {
+    stop();
+}
+
+void ComputePool::start() {
+    assert(!running_);
+    running_ = true;
+    for(int i=0; i<size(); i++) {
+        workers_[i]->thread = std::thread(&ComputePool::workerThread, this, i);
+    }
+    log_trace("ComputePool %p started %d workers", this, size());
+}
+
+void ComputePool::stop() {
+    if(!running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_all();
+    }
+    for(auto& worker: workers_) {
+        worker->thread.join();
+    }
+    log_trace("ComputePool %p stopped", this);
+}
+
+void ComputePool::submit(Task&& task) {
+    if(t_pool == this) {
+        push(*workers_[t_workerIndex], std::move(task), false);
+    }
+    else {
+        size_t index = next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        push(*workers_[index], std::move(task), false);
+    }
+}
+
+void ComputePool::submit(size_t key, Task&& task) {
+    push(*workers_[key % workers_.size()], std::move(task), true);
+}
+
+void ComputePool::push(Worker& worker, Task&& task, bool pinned) {
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(pinned) {
+            worker.pinned.push_back(std::move(task));
+        }
+        else {
+            worker.tasks.push_back(std::move(task));
+        }
+    }
+    if(pinned) {
+        worker.pinnedCount.fetch_add(1);
+    }
+    else {
+        pending_.fetch_add(1);
+    }
+    // 与 worker 中 sleepers_++ 后检查任务数的顺序相对，二者至少有一方看到对方的修改
+    if(sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // pinned 任务只能由指定的 worker 执行，无法确定唤醒的是哪一个
+        if(pinned) {
+            cond_.notify_all();
+        }
+        else {
+            cond_.notify_one();
+        }
+    }
+}
+
+bool ComputePool::takeTask(int index, Task& task) {
+    Worker& self = *workers_[index];
+    {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if(!self.pinned.empty()) {
+            task = std::move(self.pinned.front());
+            self.pinned.pop_front();
+            self.pinnedCount.fetch_sub(1);
+            return true;
+        }
+        if(!self.tasks.empty()) {
+            task = std::move(self.tasks.back());
+            self.tasks.pop_back();
+            pending_.fetch_sub(1);
+            return true;
+        }
+    }
+    const int n = size();
+    for(int i=1; i<n; i++) {
+        Worker& victim = *workers_[(index + i) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending_.fetch_sub(1);
+            stolen_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ComputePool::workerThread(int index) {
+    t_pool = this;
+    t_workerIndex = index;
+    Worker& self = *workers_[index];
+    Task task;
+    while(true) {
+        if(takeTask(index, task)) {
+            task();
+            task = nullptr; // 尽早释放任务捕获的对象
+            executed_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleepers_.fetch_add(1);
+        while(!hasWork(self) && running_) {
+            cond_.wait(lock);
+        }
+        sleepers_.fetch_sub(1);
+        if(!hasWork(self) && !running_) {
+            break;
+        }
+    }
+    t_pool = nullptr;
+    t_workerIndex = -1;
+}
+
+ComputePool::Stats ComputePool::stats() const {
+    Stats stats;
+    stats.executed = executed_.load(std::memory_order_relaxed);
+    stats.stolen = stolen_.load(std::memory_order_relaxed);
+    return stats;
+}
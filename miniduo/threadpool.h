@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory> // std::unique_ptr<T>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility> // std::move
+#include <vector>
+
+#include "EventLoop.h"
+#include "function.h"
+
+namespace miniduo {
+
+/// 计算线程池，用于把 MsgCallback 中耗 CPU 的工作 (压缩、解析等) 移出 EventLoop
+/// 每个 worker 有自己的任务队列，空闲时从其他 worker 的队列头部窃取任务；
+/// worker 内部提交的任务进入本 worker 的队列尾部并优先执行 (LIFO)
+/// 带 key 的任务固定在 key 对应的 worker 上按 FIFO 执行且不会被窃取，
+/// 因此同一 key (如同一个 TcpConnection) 的任务及其结果回调保持提交顺序
+class ComputePool {
+    ComputePool(const ComputePool&) = delete;
+    ComputePool& operator=(const ComputePool&) = delete;
+public:
+    typedef SmallFunction<void()> Task;
+
+    struct Stats {
+        uint64_t executed; // 已执行的任务数
+        uint64_t stolen;   // 其中从其他 worker 窃取的任务数
+    };
+
+    explicit ComputePool(int numThreads = std::thread::hardware_concurrency());
+    /// 等待已提交的任务执行完毕后回收线程
+    ~ComputePool();
+
+    void start();
+    /// @brief 不再接受新任务，执行完已提交的任务后退出所有 worker
+    void stop();
+
+    // thread safe
+    void submit(Task&& task);
+    // thread safe, 同一 key 的任务按提交顺序串行执行
+    void submit(size_t key, Task&& task);
+
+    /// @brief 在线程池中执行 work()，再通过 loop->runInLoop() 在 loop 线程中执行 done(result)
+    /// work 返回 void 时 done 不带参数
+    template <class Work, class Done>
+    void submit(EventLoop* loop, Work&& work, Done&& done) {
+        submit(bindDone(loop, std::forward<Work>(work), std::forward<Done>(done)));
+    }
+    /// @brief 同上，同一 key 的 work 与 done 均按提交顺序执行
+    template <class Work, class Done>
+    void submit(size_t key, EventLoop* loop, Work&& work, Done&& done) {
+        submit(key, bindDone(loop, std::forward<Work>(work), std::forward<Done>(done)));
+    }
+
+    int size() const { return static_cast<int>(workers_.size()); }
+    // thread safe, 计数为近似值
+    Stats stats() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;  // 可被窃取
+        std::deque<Task> pinned; // 带 key 的任务，只由本 worker 执行
+        std::atomic<long> pinnedCount{0};
+        std::thread thread;
+    };
+
+    template <class Work, class Done>
+    static Task bindDone(EventLoop* loop, Work&& work, Done&& done) {
+        typedef typename std::decay<Work>::type WorkT;
+        typedef typename std::decay<Done>::type DoneT;
+        typedef std::is_void<decltype(std::declval<WorkT&>()())> VoidResult;
+        return [loop, work = WorkT(std::forward<Work>(work)),
+                done = DoneT(std::forward<Done>(done))]() mutable {
+            runWork(loop, work, done, VoidResult());
+        };
+    }
+
+    // work 返回 void: done 不带参数
+    template <class WorkT, class DoneT>
+    static void runWork(EventLoop* loop, WorkT& work, DoneT& done, std::true_type) {
+        work();
+        loop->runInLoop(std::move(done));
+    }
+    // 结果移入 done 所在的任务
+    template <class WorkT, class DoneT>
+    static void runWork(EventLoop* loop, WorkT& work, DoneT& done, std::false_type) {
+        loop->runInLoop(
+            [done = std::move(done), result = work()]() mutable {
+                done(std::move(result));
+            });
+    }
+
+    void push(Worker& worker, Task&& task, bool pinned);
+    void workerThread(int index);
+    // 依次尝试本 worker 的 pinned 队列、本地队列、其他 worker 的队列
+    bool takeTask(int index, Task& task);
+    bool hasWork(const Worker& worker) const {
+        return pending_.load() > 0 || worker.pinnedCount.load() > 0;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> next_;     // 外部线程提交时轮转选择 worker
+    std::atomic<long> pending_;    // 已提交尚未被取走的可窃取任务数
+    std::atomic<int> sleepers_;    // 等待在 cond_ 上的 worker 数
+    std::atomic<bool> running_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::atomic<uint64_t> executed_;
+    std::atomic<uint64_t> stolen_;
+
+}; // class ComputePool
+
+} // namespace miniduo
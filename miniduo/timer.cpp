@@ -4,12 +4,16 @@
 #include "util.h"
 
 #include <unistd.h> // close()
+#include <algorithm>
 #include <cassert>  // assert()
 #include <sys/timerfd.h> // timerfd_*()
 #include <cstring> // memset()
 #include <sys/time.h> // gettimeofday() unused !!!
 #include <chrono> 
 
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::TIMER
+
 
 namespace miniduo {
 //  3 timerfd helper funtions
@@ -63,11 +67,229 @@ void closeTimerfd(int fd) {
 
 using namespace miniduo;
 
+namespace {
+const int64_t kWheelTickUs = 100 * 1000; // 粗粒度定时器的精度 100ms
+} // namespace
+
+void WheelTimer::cancel() {
+    if(wheel_ != nullptr) {
+        wheel_->cancel(this);
+    }
+}
+
+const int TimerWheel::kLevels;
+const size_t TimerWheel::kRootSize;
+const size_t TimerWheel::kLevelSize;
+const uint64_t TimerWheel::kMaxTicks;
+
+TimerWheel::TimerWheel(int64_t tickUs, Timestamp now)
+    : tickUs_(tickUs),
+      start_(now),
+      current_(0),
+      size_(0),
+      slots_(kRootSize + (kLevels - 1) * kLevelSize)
+{
+    assert(tickUs_ > 0);
+    for(WheelLink& head: slots_) {
+        head.prev = &head;
+        head.next = &head;
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    // 剩余的定时器与时间轮解除关联，之后析构时不再访问时间轮
+    for(WheelLink& head: slots_) {
+        for(WheelLink* link = head.next; link != &head; ) {
+            WheelTimer* timer = static_cast<WheelTimer*>(link);
+            link = link->next;
+            timer->prev = nullptr;
+            timer->next = nullptr;
+            timer->wheel_ = nullptr;
+        }
+    }
+}
+
+void TimerWheel::add(WheelTimer* timer, double delay) {
+    insert(timer, delay, current_);
+}
+
+void TimerWheel::add(WheelTimer* timer, double delay, Timestamp now) {
+    // now 所在的 tick 还可能在下一次 advance() 中处理，从它之后开始计算
+    uint64_t base = current_;
+    if(now >= start_) {
+        base = std::max(base, static_cast<uint64_t>((now - start_) / tickUs_) + 1);
+    }
+    insert(timer, delay, base);
+}
+
+void TimerWheel::insert(WheelTimer* timer, double delay, uint64_t base) {
+    if(timer->wheel_ != nullptr) {
+        timer->wheel_->cancel(timer);
+    }
+    uint64_t ticks = 0;
+    if(delay > 0) {
+        // 向上取整，不会早于 delay 到期 (相对于 base)
+        ticks = static_cast<uint64_t>((delay * 1000000 + tickUs_ - 1) / tickUs_);
+    }
+    // place() 按相对 current_ 的距离选择层，距离不能超过最长的定时
+    timer->expireTick_ = std::min(base + std::min(ticks, kMaxTicks), current_ + kMaxTicks);
+    timer->wheel_ = this;
+    size_++;
+    place(timer);
+}
+
+void TimerWheel::cancel(WheelTimer* timer) {
+    if(timer->wheel_ != this) {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+    timer->wheel_ = nullptr;
+    size_--;
+}
+
+void TimerWheel::advance(Timestamp now) {
+    if(now < start_) {
+        return;
+    }
+    const uint64_t target = static_cast<uint64_t>((now - start_) / tickUs_);
+    if(size_ == 0) {
+        // 没有定时器时直接跳过空转的 tick
+        current_ = std::max(current_, target + 1);
+        return;
+    }
+    // 跳过到下一个事件之间的空 tick，长时间没有到期的定时器时不必逐个 tick 推进
+    current_ = std::max(current_, std::min(nextEventTick(), target + 1));
+    while(current_ <= target) {
+        tick();
+    }
+}
+
+void TimerWheel::place(WheelTimer* timer) {
+    const uint64_t expire = timer->expireTick_;
+    const uint64_t delta = expire - current_;
+    WheelLink* head = nullptr;
+    if(delta < kRootSize) {
+        head = slot(0, expire & (kRootSize - 1));
+    }
+    else {
+        for(int level = 1; level < kLevels; level++) {
+            if(delta < (uint64_t(1) << (kRootBits + level * kLevelBits))) {
+                head = slot(level, (expire >> (kRootBits + (level - 1) * kLevelBits)) & (kLevelSize - 1));
+                break;
+            }
+        }
+    }
+    assert(head != nullptr);
+    // 加到槽位链表的末尾
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void TimerWheel::tick() {
+    const size_t index = current_ & (kRootSize - 1);
+    if(index == 0) {
+        // 下层转完一圈，依次把上层当前槽位的定时器分配下来
+        for(int level = 1; level < kLevels; level++) {
+            size_t levelIndex = (current_ >> (kRootBits + (level - 1) * kLevelBits)) & (kLevelSize - 1);
+            cascade(level, levelIndex);
+            if(levelIndex != 0) {
+                break;
+            }
+        }
+    }
+    // 先取下到期链表并推进 current_，回调中新加入的定时器不会落入这个槽位
+    WheelLink expired;
+    WheelLink* head = slot(0, index);
+    if(head->next == head) {
+        current_++;
+        return;
+    }
+    expired.next = head->next;
+    expired.prev = head->prev;
+    expired.next->prev = &expired;
+    expired.prev->next = &expired;
+    head->next = head;
+    head->prev = head;
+    current_++;
+    while(expired.next != &expired) {
+        WheelTimer* timer = static_cast<WheelTimer*>(expired.next);
+        cancel(timer);
+        // 回调中可以再次加入该定时器，但不能析构它
+        if(timer->callback_) {
+            timer->callback_();
+        }
+    }
+}
+
+void TimerWheel::cascade(int level, size_t index) {
+    WheelLink* head = slot(level, index);
+    WheelLink pending;
+    if(head->next == head) {
+        return;
+    }
+    pending.next = head->next;
+    pending.prev = head->prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    head->next = head;
+    head->prev = head;
+    while(pending.next != &pending) {
+        WheelTimer* timer = static_cast<WheelTimer*>(pending.next);
+        pending.next = timer->next;
+        timer->next->prev = &pending;
+        place(timer);
+    }
+}
+
+uint64_t TimerWheel::nextEventTick() const {
+    uint64_t next = current_ + kMaxTicks + 1;
+    // 第 0 层的定时器都在 [current_, current_ + kRootSize) 内到期
+    for(size_t i = 0; i < kRootSize; i++) {
+        const WheelLink* head = slot(0, (current_ + i) & (kRootSize - 1));
+        if(head->next != head) {
+            next = current_ + i;
+            break;
+        }
+    }
+    // 第 level 层的槽位在低位全为 0 的 tick 上分配到下层 (见 tick())
+    for(int level = 1; level < kLevels; level++) {
+        const int shift = kRootBits + (level - 1) * kLevelBits;
+        const uint64_t period = uint64_t(1) << shift;
+        uint64_t t = (current_ + period - 1) & ~(period - 1);
+        for(size_t k = 0; k < kLevelSize && t < next; k++, t += period) {
+            const WheelLink* head = slot(level, (t >> shift) & (kLevelSize - 1));
+            if(head->next != head) {
+                next = t;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+WheelLink* TimerWheel::slot(int level, size_t index) {
+    if(level == 0) {
+        return &slots_[index];
+    }
+    return &slots_[kRootSize + (level - 1) * kLevelSize + index];
+}
+
+const WheelLink* TimerWheel::slot(int level, size_t index) const {
+    return const_cast<TimerWheel*>(this)->slot(level, index);
+}
+
 TimerQueue::TimerQueue(EventLoop* loop)
     : loop_(loop),
       timerfd_(createTimerfd()),
       timerfdChannel_(loop, timerfd_),
-      timers_()
+      timers_(),
+      wheel_(kWheelTickUs, util::getMonotonicNow()),
+      nextAlarm_(0)
 {
     timerfdChannel_.setReadCallback(
         std::bind(&TimerQueue::handleRead, this, std::placeholders::_1)
@@ -106,9 +328,27 @@ void TimerQueue::enableChannel() {
 void TimerQueue::addTimer(std::shared_ptr<Timer> timer) {
     loop_->assertInLoopThread();
     Timestamp when = timer->expiration();
-    bool earliestChanged = insert(std::move(timer));
-    if(earliestChanged) {
+    insert(std::move(timer));
+    // timerfd 设置为 timers_ 与时间轮中更早的一个
+    if(nextAlarm_ == 0 || when < nextAlarm_) {
         resetTimerfd(timerfd_, when);
+        nextAlarm_ = when;
+    }
+}
+
+void TimerQueue::addWheelTimer(WheelTimer* timer, double delay) {
+    loop_->assertInLoopThread();
+    if(wheel_.empty()) {
+        // 时间轮为空时不推进，先追上当前时间 (不会运行定时器)
+        wheel_.advance(loop_->monotonicTime());
+    }
+    // 非空时也只在有事件时推进，current_ 可能落后于当前时间，以当前时间为起点
+    wheel_.add(timer, delay, loop_->monotonicTime());
+    // 只可能提前到这个定时器的到期时间，不必扫描时间轮
+    Timestamp next = wheelToWallTime(wheel_.expireTime(timer));
+    if(nextAlarm_ == 0 || next < nextAlarm_) {
+        resetTimerfd(timerfd_, next);
+        nextAlarm_ = next;
     }
 }
 
@@ -135,7 +375,8 @@ void TimerQueue::handleRead(Timestamp recvTime) {
     // handleRead will be called in EventLoop::loop()
     loop_->assertInLoopThread();
     log_trace("Handling timers...");
-    Timestamp now = util::getTimeOfNow();
+    // 本轮 poll 返回的时间，不再读取时钟；之后到期的定时器由重新设置的 timerfd 处理
+    Timestamp now = loop_->pollReturnTime();
     readTimerfd(timerfd_, now);
     std::vector<TimerEntry> expired = getExpired(now);
     log_trace("Total alarmed timers are %d", expired.size());
@@ -145,6 +386,7 @@ void TimerQueue::handleRead(Timestamp recvTime) {
     {
         it->second->run();
     }
+    wheel_.advance(loop_->monotonicTime());
     // add repeatable Timer back to TimerQueue;
     reset(expired, now);
     log_trace("timers_.size() == %d", timers_.size());
@@ -169,7 +411,6 @@ std::vector<TimerQueue::TimerEntry> TimerQueue::getExpired(Timestamp now) {
 }
 
 void TimerQueue::reset(const std::vector<TimerEntry>& expired, Timestamp now) {
-    Timestamp nextExpire = 0;
     for(std::vector<TimerEntry>::const_iterator it = expired.begin();
         it != expired.end();
         ++it )
@@ -180,13 +421,29 @@ void TimerQueue::reset(const std::vector<TimerEntry>& expired, Timestamp now) {
         }
     }
     // reset next alarm timestamp of timerfd_
+    resetTimerfdToNext();
+}
+
+void TimerQueue::resetTimerfdToNext() {
+    Timestamp nextExpire = 0;
     if(!timers_.empty()) {
         nextExpire = timers_.begin()->second->expiration();
     }
+    if(!wheel_.empty()) {
+        Timestamp wheelNext = wheelToWallTime(wheel_.nextEventTime());
+        if(nextExpire == 0 || wheelNext < nextExpire) {
+            nextExpire = wheelNext;
+        }
+    }
     if(nextExpire > 0) {
         resetTimerfd(timerfd_, nextExpire);
     }
+    nextAlarm_ = nextExpire;
+}
 
+Timestamp TimerQueue::wheelToWallTime(Timestamp monotonic) const {
+    // 两个缓存的时钟在同一次 poll 返回后刷新，差值即两个时钟的偏移
+    return loop_->pollReturnTime() + (monotonic - loop_->monotonicTime());
 }
 
 bool TimerQueue::insert(std::shared_ptr<Timer> timer) {
@@ -47,6 +47,100 @@ private:
 
 }; // class Timer
 
+class TimerWheel;
+
+// 时间轮槽位中的双向循环链表节点
+struct WheelLink {
+    WheelLink* prev;
+    WheelLink* next;
+};
+
+/// 粗粒度定时器，由使用者持有 (例如作为 TcpConnection 的成员)，加入、取消、刷新都是 O(1)
+/// 不重复；到期后可在回调中再次加入。只在所属 loop 线程中使用
+class WheelTimer : private WheelLink {
+    WheelTimer(const WheelTimer&) = delete;
+    WheelTimer& operator=(const WheelTimer&) = delete;
+public:
+    WheelTimer() : WheelLink{nullptr, nullptr}, wheel_(nullptr), expireTick_(0) {}
+    explicit WheelTimer(TimerCallback cb)
+        : WheelLink{nullptr, nullptr}, wheel_(nullptr), expireTick_(0), callback_(std::move(cb))
+    {}
+    ~WheelTimer() { cancel(); }
+
+    void setCallback(TimerCallback cb) { callback_ = std::move(cb); }
+    bool pending() const { return wheel_ != nullptr; }
+    /// @brief 从时间轮中移除，未加入时无操作
+    void cancel();
+
+private:
+    friend class TimerWheel;
+    TimerWheel* wheel_;   // 所在的时间轮，未加入时为空
+    uint64_t expireTick_;
+    TimerCallback callback_;
+
+}; // class WheelTimer
+
+/// 分层时间轮: 第 0 层 256 个槽位，每个 tick 一个；第 1-3 层各 64 个槽位，
+/// 每个槽位跨越下一层一整圈，下层转完一圈时把对应槽位的定时器重新分配到下层
+/// 定时器在到期 tick 之后的第一次 advance() 中运行，误差不超过一个 tick
+class TimerWheel {
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+public:
+    TimerWheel(int64_t tickUs, Timestamp now);
+    ~TimerWheel();
+
+    /// @brief 加入或刷新 (已加入时先移除) 定时器，delay 秒后到期，O(1)
+    /// 以时间轮已推进到的 tick 为起点，不读取时钟
+    void add(WheelTimer* timer, double delay);
+    /// @brief 同上，以 now 所在 tick 的下一个 tick 为起点 (时间轮落后于 now 时)，
+    /// 时间轮非空、有一段时间没有 advance() 时不会早于 now + delay 到期
+    void add(WheelTimer* timer, double delay, Timestamp now);
+    /// @brief 移除定时器，O(1)
+    void cancel(WheelTimer* timer);
+    /// @brief 推进到 now，运行所有到期的定时器
+    void advance(Timestamp now);
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    int64_t tickUs() const { return tickUs_; }
+    /// @brief 时间轮非空时下一次需要调用 advance() 的时间: 最近的非空槽位到期或
+    /// 上层非空槽位分配到下层的 tick，其间的 tick 都是空的，不需要逐个唤醒；O(槽位数)
+    Timestamp nextEventTime() const { return tickTime(nextEventTick()); }
+    /// @brief 已加入的定时器的到期时间
+    Timestamp expireTime(const WheelTimer* timer) const { return tickTime(timer->expireTick_); }
+
+private:
+    static const int kLevels = 4;
+    static const int kRootBits = 8;
+    static const int kLevelBits = 6;
+    static const size_t kRootSize = 1 << kRootBits;
+    static const size_t kLevelSize = 1 << kLevelBits;
+    // 最长的定时，更长的定时按此计算
+    static const uint64_t kMaxTicks = (uint64_t(1) << (kRootBits + (kLevels - 1) * kLevelBits)) - 1;
+
+    // 从 base 起 delay 秒后到期
+    void insert(WheelTimer* timer, double delay, uint64_t base);
+    // 按到期 tick 放入对应的层和槽位
+    void place(WheelTimer* timer);
+    // 处理 current_ 这一个 tick
+    void tick();
+    // 把 level 层 index 槽位的定时器重新分配到下层
+    void cascade(int level, size_t index);
+    // 从 current_ 起第一个需要处理的 tick，见 nextEventTime()
+    uint64_t nextEventTick() const;
+    Timestamp tickTime(uint64_t tick) const { return start_ + static_cast<Timestamp>(tick) * tickUs_; }
+    WheelLink* slot(int level, size_t index);
+    const WheelLink* slot(int level, size_t index) const;
+
+    const int64_t tickUs_;
+    const Timestamp start_;
+    uint64_t current_; // 下一个要处理的 tick, 之前的 tick 都已处理
+    size_t size_;
+    // 第 0 层 kRootSize 个槽位，之后每层 kLevelSize 个
+    std::vector<WheelLink> slots_;
+
+}; // class TimerWheel
+
 class TimerQueue {
     TimerQueue(const TimerQueue&) = delete;
     TimerQueue& operator=(const TimerQueue&) = delete;
@@ -59,6 +153,8 @@ public:
     void addTimer(std::shared_ptr<Timer> timer);
     /// Not Thread safe
     void cancelTimer(TimerId timerId);
+    /// @brief 加入或刷新粗粒度定时器，Not Thread safe
+    void addWheelTimer(WheelTimer* timer, double delay);
     /// @brief  Called by EventLoop to register the tiemrfd channel to poller
     void enableChannel() ;
 
@@ -75,6 +171,10 @@ private:
     /// @brief  Insert a new timer ptr into timers_
     /// @return return true if the earliest expiration in timers_ changed
     bool insert(std::shared_ptr<Timer> timer);
+    /// @brief 按 timers_ 最早的到期时间和时间轮的下一个 tick 设置 timerfd
+    void resetTimerfdToNext();
+    // 时间轮按 monotonic clock 计时 (不受系统时间调整影响)，timers_ 与 timerfd 按 wall clock
+    Timestamp wheelToWallTime(Timestamp monotonic) const;
   
     // void addTimerInLoop(std::shared_ptr<Timer> timer);
 
@@ -82,6 +182,8 @@ private:
     const int timerfd_;
     Channel timerfdChannel_;
     TimerList timers_; // Timer list sorted by expiration
+    TimerWheel wheel_; // 粗粒度定时器，按 EventLoop::monotonicTime() 推进
+    Timestamp nextAlarm_; // timerfd 设置的到期时间，0 表示未设置
 
 }; // class TimerQueue
 
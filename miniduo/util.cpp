@@ -32,6 +32,11 @@ Timestamp getTimeOfNow() {
     return (Timestamp)std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
 }
 
+Timestamp getMonotonicNow() {
+    auto now = std::chrono::steady_clock::now();
+    return (Timestamp)std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+}
+
 std::string timeString(Timestamp now) {
     time_t tt = now / 1e6;
     struct tm timeinfo;
@@ -16,6 +16,8 @@ namespace util {
 
 pid_t currentTid();
 Timestamp getTimeOfNow();
+// microseconds of the monotonic clock, 只用于计算间隔
+Timestamp getMonotonicNow();
 std::string timeString(Timestamp now);
 
 class AutoContext {
@@ -0,0 +1,115 @@
+// 缓存时钟的收益:
+// 日志时间戳: 每次 localtime_r + snprintf 与 LogTimeFormatter (同一秒内复用日期时间部分)
+// 读取时间: util::getTimeOfNow() 与 EventLoop::pollReturnTime()
+// 定时器: loop 线程中 runAt(getTimeOfNow() + delay) 与 runAfter() (使用缓存的时间)
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "miniduo/EventLoop.h"
+#include "miniduo/logging.h"
+#include "miniduo/util.h"
+#include "testutil.h"
+
+using namespace miniduo;
+
+typedef std::chrono::steady_clock Clock;
+
+double msSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// 此前 Logger::timeNow() 的做法
+int formatEachTime(int64_t microseconds, char* buf, size_t len) {
+    time_t tt = microseconds / 1000000;
+    struct tm timeinfo;
+    localtime_r(&tt, &timeinfo);
+    return snprintf(buf, len, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
+                    timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday,
+                    timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec,
+                    static_cast<int>(microseconds / 1000 % 1000));
+}
+
+void benchLogTime() {
+    const int kLines = 1000000;
+    // 每行相隔 3us, 约 3 秒的日志
+    const Timestamp start = util::getTimeOfNow();
+    char a[64];
+    char b[64];
+    for(int i=0; i<kLines; i += 997) {
+        LogTimeFormatter formatter;
+        Timestamp t = start + i * 3;
+        formatEachTime(t, a, sizeof a);
+        formatter.format(t, b);
+        check(strcmp(a, b) == 0, "formatter output");
+    }
+    size_t sum = 0;
+    auto begin = Clock::now();
+    for(int i=0; i<kLines; i++) {
+        sum += formatEachTime(start + i * 3, a, sizeof a);
+    }
+    double eachMs = msSince(begin);
+    LogTimeFormatter formatter;
+    begin = Clock::now();
+    for(int i=0; i<kLines; i++) {
+        sum += formatter.format(start + i * 3, b);
+    }
+    double cachedMs = msSince(begin);
+    check(sum == 2u * kLines * LogTimeFormatter::kLength, "formatted length");
+    printf("log timestamp x %d: localtime_r + snprintf %7.1f ms  LogTimeFormatter %7.1f ms\n",
+           kLines, eachMs, cachedMs);
+}
+
+void benchTimers() {
+    const int kReads = 10000000;
+    const int kTimers = 100000;
+    EventLoop loop;
+    loop.runAfter(0, [&] {
+        Timestamp sum = 0;
+        volatile Timestamp sink = 0; // 防止循环被优化掉
+        auto begin = Clock::now();
+        for(int i=0; i<kReads; i++) {
+            sum += util::getTimeOfNow();
+        }
+        double clockMs = msSince(begin);
+        begin = Clock::now();
+        for(int i=0; i<kReads; i++) {
+            sink = loop.pollReturnTime();
+        }
+        double cachedMs = msSince(begin);
+        check(sum != 0 && sink != 0, "clock readings");
+        printf("read time x %d: getTimeOfNow %7.1f ms  pollReturnTime %7.1f ms\n",
+               kReads, clockMs, cachedMs);
+
+        std::vector<TimerId> ids(kTimers);
+        begin = Clock::now();
+        for(int i=0; i<kTimers; i++) {
+            ids[i] = loop.runAt(util::getTimeOfNow() + 30 * 1000000, [] {});
+        }
+        for(auto& id: ids) {
+            loop.cancel(id);
+        }
+        double readMs = msSince(begin);
+        begin = Clock::now();
+        for(int i=0; i<kTimers; i++) {
+            ids[i] = loop.runAfter(30, [] {});
+        }
+        for(auto& id: ids) {
+            loop.cancel(id);
+        }
+        double runAfterMs = msSince(begin);
+        printf("timer add + cancel x %d: runAt(getTimeOfNow()) %7.1f ms  runAfter %7.1f ms\n",
+               kTimers, readMs, runAfterMs);
+        loop.quit();
+    });
+    loop.loop();
+}
+
+int main() {
+    benchLogTime();
+    benchTimers();
+    printf("%s\n", g_ok ? "all passed" : "FAILED");
+    return g_ok ? 0 : 1;
+}
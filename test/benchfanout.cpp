@@ -0,0 +1,126 @@
+// 广播基准: 另一个线程向所有连接发送同一份消息，
+// 比较 send(const std::string&) (每个任务和每个 output buffer 各拷贝一次)
+// 与 send(const PayloadPtr&) (只传递引用) 的耗时和内存峰值
+// 每种方式在独立的子进程中运行
+#include "miniduo/conn.h"
+#include "miniduo/EventLoop.h"
+#include "miniduo/net.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace miniduo;
+
+const int kSubLoops = 4;
+const int kConns = 200;
+const int kRounds = 20;
+const size_t kPayloadSize = 64 * 1024;
+const int kBasePort = 19510;
+
+typedef std::chrono::steady_clock Clock;
+
+void runMode(const char* name, bool shared, int port) {
+    EventLoops loops(kSubLoops);
+    TcpServer server(&loops, SockAddr(port));
+    std::mutex mutex;
+    std::vector<TcpConnectionPtr> conns;
+    server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        if(conn->connected()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            conns.push_back(conn);
+        }
+    });
+    server.setMsgCallback([](const TcpConnectionPtr&, Buffer* buf, Timestamp) {
+        buf->retrieveAll();
+    });
+    server.start();
+    std::thread loopThread([&loops] { loops.loop(); });
+    usleep(100 * 1000);
+
+    int epfd = ::epoll_create1(0);
+    std::vector<int> fds;
+    for(int i=0; i<kConns; i++) {
+        int fd = connectTo(port);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        fds.push_back(fd);
+    }
+    while(true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(conns.size() == static_cast<size_t>(kConns)) {
+                break;
+            }
+        }
+        usleep(1000);
+    }
+
+    const size_t expected = static_cast<size_t>(kConns) * kRounds * kPayloadSize;
+    auto start = Clock::now();
+    std::thread broadcaster([&] {
+        for(int r=0; r<kRounds; r++) {
+            std::string msg(kPayloadSize, static_cast<char>('a' + r));
+            if(shared) {
+                PayloadPtr payload = std::make_shared<const Payload>(std::move(msg));
+                for(auto& conn: conns) {
+                    conn->send(payload);
+                }
+            }
+            else {
+                for(auto& conn: conns) {
+                    conn->send(msg);
+                }
+            }
+        }
+    });
+    size_t received = 0;
+    char buf[65536];
+    epoll_event events[64];
+    while(received < expected) {
+        int n = ::epoll_wait(epfd, events, 64, 1000);
+        if(n <= 0) {
+            break;
+        }
+        for(int i=0; i<n; i++) {
+            ssize_t len = ::read(events[i].data.fd, buf, sizeof buf);
+            if(len > 0) {
+                received += len;
+            }
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    broadcaster.join();
+
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    printf("%-22s %d conns x %d rounds x %zu KiB  %8.1f ms  %7.1f MiB/s  max rss %6ld MiB%s\n",
+           name, kConns, kRounds, kPayloadSize / 1024, ms,
+           received / 1048576.0 / (ms / 1000), usage.ru_maxrss / 1024,
+           received == expected ? "" : "  (incomplete)");
+    fflush(stdout);
+    // 不析构 TcpServer / EventLoops, 直接结束子进程
+    _exit(0);
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool shared;
+    } modes[] = {
+        {"send(std::string)", false},
+        {"send(PayloadPtr)", true},
+    };
+    runModes(modes, kBasePort, [](const auto& m, int port) {
+        runMode(m.name, m.shared, port);
+    });
+    return 0;
+}
@@ -0,0 +1,172 @@
+// 空闲连接的缓冲区内存: 每个连接先收发一次 64 KiB 的突发消息，之后保持空闲，
+// 比较不回收与 setBufferIdleTimeout() 回收时 TcpServer::bufferBytes() 的变化
+// 每种方式在独立的子进程中运行；另检查只有服务端发送的连接在发送期间不回收
+#include "miniduo/conn.h"
+#include "miniduo/EventLoop.h"
+#include "miniduo/net.h"
+#include "testutil.h"
+
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace miniduo;
+
+const int kSubLoops = 2;
+const int kConns = 2000;
+const size_t kBurst = 64 * 1024;
+const int kBasePort = 19610;
+
+void printMem(const char* name, const char* phase, const TcpServer& server) {
+    double perConn = static_cast<double>(server.bufferBytes()) / kConns;
+    printf("%-16s %-12s %8.1f MiB  %8.0f B/conn  (x100k conns: %7.1f GiB)\n",
+           name, phase, server.bufferBytes() / 1048576.0, perConn,
+           perConn * 100000 / (1 << 30));
+}
+
+void runMode(const char* name, double idleTimeout, int port) {
+    EventLoops loops(kSubLoops);
+    TcpServer server(&loops, SockAddr(port));
+    server.setBufferIdleTimeout(idleTimeout);
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMsgCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+        // 收齐后整体回显，input buffer 增长到整条消息的大小
+        if(buf->readableBytes() >= kBurst) {
+            conn->send(buf->retrieveAsString());
+        }
+    });
+    server.start();
+    std::thread loopThread([&loops] { loops.loop(); });
+    usleep(100 * 1000);
+
+    std::vector<int> fds;
+    for(int i=0; i<kConns; i++) {
+        fds.push_back(connectNoDelay(port));
+        if(i % 16 == 15) {
+            usleep(1000); // listen backlog 只有 20，让 acceptor 跟上
+        }
+    }
+    usleep(100 * 1000);
+    printMem(name, "connected", server);
+
+    std::string burst(kBurst, 'x');
+    std::vector<char> buf(kBurst);
+    for(int fd: fds) {
+        // 64 KiB 能放入 loopback 的发送缓冲区，先整体发送再等待回显
+        if(::send(fd, burst.data(), kBurst, 0) != static_cast<ssize_t>(kBurst)) {
+            perror("send");
+            _exit(1);
+        }
+        size_t got = 0;
+        while(got < kBurst) {
+            ssize_t n = ::recv(fd, buf.data(), buf.size(), 0);
+            if(n <= 0) {
+                break;
+            }
+            got += n;
+        }
+    }
+    usleep(50 * 1000);
+    printMem(name, "after burst", server);
+    sleep(1);
+    printMem(name, "idle 1s", server);
+    printf("%-16s new connection input buffer: %zu bytes\n",
+           name, loops.ioLoops()[0]->bufferSizeHint());
+    fflush(stdout);
+    // 不析构 TcpServer / EventLoops, 直接结束子进程
+    _exit(0);
+}
+
+// 突发消息后的超时之内、以及服务端持续发送 (客户端只读) 期间缓冲区不回收，
+// 停止发送后超时回收；时间轮中一直有远期的定时器时，回收后的读写同样不提前回收
+void checkReclaim(int port) {
+    const double kIdleTimeout = 0.4;
+    EventLoops loops(1);
+    TcpServer server(&loops, SockAddr(port));
+    server.setBufferIdleTimeout(kIdleTimeout);
+    std::mutex mutex;
+    TcpConnectionPtr pusher;
+    server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pusher = conn->connected() ? conn : TcpConnectionPtr();
+    });
+    server.setMsgCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+        if(buf->readableBytes() >= kBurst) {
+            conn->send(buf->retrieveAsString());
+        }
+    });
+    server.start();
+    std::thread loopThread([&loops] { loops.loop(); });
+    EventLoop* ioLoop = loops.ioLoops()[0];
+    WheelTimer longTimer;
+    ioLoop->runInLoop([&] { ioLoop->addWheelTimer(&longTimer, 60); });
+    usleep(100 * 1000);
+
+    bool ok = true;
+    int fd = connectNoDelay(port);
+    usleep(100 * 1000);
+    std::string burst(kBurst, 'x');
+    std::vector<char> buf(kBurst);
+    if(::send(fd, burst.data(), kBurst, 0) != static_cast<ssize_t>(kBurst)) {
+        perror("send");
+        _exit(1);
+    }
+    for(size_t got = 0; got < kBurst; ) {
+        ssize_t n = ::recv(fd, buf.data(), buf.size(), 0);
+        if(n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    usleep(100 * 1000);
+    const int64_t afterBurst = server.bufferBytes();
+    ok = ok && afterBurst >= static_cast<int64_t>(kBurst);
+    // 服务端每 100ms 发送一次，持续 3 个超时
+    for(int i=0; i<12; i++) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pusher->send(std::string("p"));
+        }
+        usleep(100 * 1000);
+        ::recv(fd, buf.data(), buf.size(), MSG_DONTWAIT);
+    }
+    const int64_t sending = server.bufferBytes();
+    ok = ok && sending >= static_cast<int64_t>(kBurst);
+    usleep(static_cast<useconds_t>(3 * kIdleTimeout * 1000000));
+    const int64_t idle = server.bufferBytes();
+    ok = ok && idle < static_cast<int64_t>(kBurst);
+    // 回收后时间轮只剩远期定时器，长时间没有推进；之后的一次读入同样在超时后才回收
+    // (每次回收把连接的输入峰值计入 bufferSizeHint())
+    const size_t hint = ioLoop->bufferSizeHint();
+    ::send(fd, "m", 1, 0);
+    usleep(100 * 1000);
+    const bool early = ioLoop->bufferSizeHint() != hint;
+    usleep(static_cast<useconds_t>(2 * kIdleTimeout * 1000000));
+    const bool reclaimed = ioLoop->bufferSizeHint() != hint;
+    ok = ok && !early && reclaimed;
+    printf("reclaim check    after burst %lld B, while sending %lld B, idle %lld B, "
+           "next message reclaimed %s  %s\n",
+           static_cast<long long>(afterBurst), static_cast<long long>(sending),
+           static_cast<long long>(idle), early ? "early" : (reclaimed ? "after timeout" : "never"),
+           ok ? "OK" : "FAILED");
+    fflush(stdout);
+    _exit(ok ? 0 : 1);
+}
+
+int main() {
+    struct {
+        const char* name;
+        double idleTimeout;
+    } modes[] = {
+        {"no reclaim", 0},
+        {"idle 0.2s", 0.2},
+    };
+    runModes(modes, kBasePort, [](const auto& m, int port) {
+        runMode(m.name, m.idleTimeout, port);
+    });
+    const int port = kBasePort + sizeof modes / sizeof modes[0];
+    return runChild([port] { checkReclaim(port); }) ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// 多个线程同时以 INFO 级别写日志时每条 log_info 的耗时 (调用线程一侧)
+// 日志输出到 /dev/null, 结果打印到 stderr
+// 先在子进程中检查: 进程退出后所有线程的日志都已写出，同一线程的日志保持顺序，
+// 参数格式化正确; TEXT / DEFERRED / BINARY (解码后) 三种格式各检查一次;
+// 以及超过线程缓冲区的流输出被截断
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "miniduo/logging.h"
+#include "testutil.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const int kLinesPerThread = 200000;
+
+const char* formatName(Logger::LogFormat format) {
+    switch(format) {
+    case Logger::LogFormat::TEXT: return "text";
+    case Logger::LogFormat::DEFERRED: return "deferred";
+    case Logger::LogFormat::BINARY: return "binary";
+    }
+    return "";
+}
+
+void run(Logger::LogFormat format, int threads) {
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<double> ns(threads);
+    std::vector<std::thread> ts;
+    for(int t=0; t<threads; t++) {
+        ts.emplace_back([&, t] {
+            ready++;
+            while(!go) {
+                std::this_thread::yield();
+            }
+            auto start = Clock::now();
+            for(int i=0; i<kLinesPerThread; i++) {
+                log_info("connection #%d received %d bytes from %s", i, t * 100 + 17, "127.0.0.1:40000");
+            }
+            ns[t] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        });
+    }
+    while(ready < threads) {
+        std::this_thread::yield();
+    }
+    auto start = Clock::now();
+    go = true;
+    for(auto& th: ts) {
+        th.join();
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    double sum = 0;
+    for(double v: ns) {
+        sum += v;
+    }
+    fprintf(stderr, "%-8s %2d threads x %d lines: %7.1f ms  %6.0f ns/line per thread  %5.2f M lines/s\n",
+            formatName(format), threads, kLinesPerThread, ms, sum / threads / kLinesPerThread,
+            threads * kLinesPerThread / ms / 1000);
+}
+
+// 突发: 每个线程写入不超过线程缓冲区容量的日志，之后等待后台线程写出，
+// 只计调用线程一侧的耗时 (后台格式化与写入不在其中)
+void runBurst(Logger::LogFormat format, int threads) {
+    const int kBurst = 1000;
+    const int kRounds = 50;
+    std::vector<double> ns(threads);
+    std::vector<std::thread> ts;
+    for(int t=0; t<threads; t++) {
+        ts.emplace_back([&, t] {
+            double sum = 0;
+            for(int r=0; r<kRounds; r++) {
+                auto start = Clock::now();
+                for(int i=0; i<kBurst; i++) {
+                    log_info("connection #%d received %d bytes from %s", i, t * 100 + 17, "127.0.0.1:40000");
+                }
+                sum += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            ns[t] = sum;
+        });
+    }
+    for(auto& th: ts) {
+        th.join();
+    }
+    double sum = 0;
+    for(double v: ns) {
+        sum += v;
+    }
+    fprintf(stderr, "%-8s %2d threads x %d bursts of %d lines: %6.0f ns/line per thread\n",
+            formatName(format), threads, kRounds, kBurst, sum / threads / kRounds / kBurst);
+}
+
+bool checkComplete(Logger::LogFormat format) {
+    const int kThreads = 8;
+    const int kLines = 50000;
+    char path[] = "/tmp/benchlogXXXXXX";
+    int fd = mkstemp(path);
+    bool exited = runChild([fd, format] {
+        dup2(fd, 1);
+        set_logLevel(Logger::LogLevel::INFO);
+        set_logFormat(format);
+        std::vector<std::thread> ts;
+        for(int t=0; t<kThreads; t++) {
+            ts.emplace_back([t] {
+                std::string peer = "10.0.0." + std::to_string(t);
+                for(int i=0; i<kLines; i++) {
+                    log_info("check %d %5u %s %.2f%%", t, static_cast<unsigned>(i), peer.c_str(), i / 4.0);
+                }
+            });
+        }
+        for(auto& th: ts) {
+            th.join();
+        }
+        exit(0); // 析构 Logger, 写出剩余的日志
+    });
+    FILE* fp = fdopen(fd, "r");
+    rewind(fp);
+    bool decoded = true;
+    if(format == Logger::LogFormat::BINARY) {
+        FILE* text = tmpfile();
+        decoded = decodeBinaryLog(fp, text);
+        fclose(fp);
+        fp = text;
+        rewind(fp);
+    }
+    std::vector<int> next(kThreads, 0);
+    int lines = 0;
+    bool ok = decoded && exited;
+    char line[512];
+    char expect[128];
+    while(fgets(line, sizeof line, fp) != nullptr) {
+        const char* p = strstr(line, "]: check ");
+        int t = 0;
+        int i = 0;
+        if(p == nullptr || sscanf(p, "]: check %d %d", &t, &i) != 2
+           || t < 0 || t >= kThreads || i != next[t]) {
+            ok = false;
+            break;
+        }
+        snprintf(expect, sizeof expect, "]: check %d %5u 10.0.0.%d %.2f%%\n", t, i, t, i / 4.0);
+        if(strcmp(p, expect) != 0) {
+            ok = false;
+            break;
+        }
+        next[t]++;
+        lines++;
+    }
+    fclose(fp);
+    unlink(path);
+    ok = ok && lines == kThreads * kLines;
+    fprintf(stderr, "check %-8s: %d threads x %d lines, %d written in order  %s\n",
+            formatName(format), kThreads, kLines, lines, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+// 比线程缓冲区 (128 KiB) 还长的流输出被截断为一条，前后的日志不受影响
+bool checkOversized() {
+    const size_t kLong = 200 * 1024;
+    char path[] = "/tmp/benchlogXXXXXX";
+    int fd = mkstemp(path);
+    bool exited = runChild([fd, kLong] {
+        dup2(fd, 1);
+        set_logLevel(Logger::LogLevel::INFO);
+        for(int i=0; i<3; i++) {
+            log_info("before %d", i);
+            streamlog_info << std::string(kLong, 'x');
+            log_info("after %d", i);
+        }
+        exit(0);
+    });
+    std::string data;
+    char buf[65536];
+    ssize_t n = 0;
+    lseek(fd, 0, SEEK_SET);
+    while((n = read(fd, buf, sizeof buf)) > 0) {
+        data.append(buf, n);
+    }
+    close(fd);
+    unlink(path);
+
+    bool ok = exited;
+    std::string expect;
+    size_t longest = 0;
+    size_t start = 0;
+    int lines = 0;
+    for(size_t end; (end = data.find('\n', start)) != std::string::npos; start = end + 1) {
+        std::string line = data.substr(start, end - start);
+        size_t p = line.find("]: ");
+        if(p == std::string::npos) {
+            ok = false;
+            break;
+        }
+        std::string msg = line.substr(p + 3);
+        if(msg.find_first_not_of('x') == std::string::npos) {
+            longest = std::max(longest, msg.size());
+            msg = "x";
+        }
+        expect += msg + "\n";
+        lines++;
+    }
+    std::string want;
+    for(int i=0; i<3; i++) {
+        want += "before " + std::to_string(i) + "\nx\nafter " + std::to_string(i) + "\n";
+    }
+    ok = ok && start == data.size() && expect == want && longest > 64 * 1024 && longest < kLong;
+    fprintf(stderr, "check oversized stream log: %d lines, longest %zu bytes  %s\n",
+            lines, longest, ok ? "OK" : "FAILED");
+    return ok;
+}
+
+int main() {
+    for(auto format: {Logger::LogFormat::TEXT, Logger::LogFormat::DEFERRED, Logger::LogFormat::BINARY}) {
+        if(!checkComplete(format)) {
+            return 1;
+        }
+    }
+    if(!checkOversized()) {
+        return 1;
+    }
+    // Logger 写 stdout (fd 1)
+    if(freopen("/dev/null", "w", stdout) == nullptr) {
+        perror("freopen");
+        return 1;
+    }
+    set_logLevel(Logger::LogLevel::INFO);
+    for(auto format: {Logger::LogFormat::TEXT, Logger::LogFormat::DEFERRED}) {
+        set_logFormat(format);
+        for(int threads: {1, 4, 16}) {
+            run(format, threads);
+        }
+        for(int threads: {1, 4}) {
+            runBurst(format, threads);
+        }
+    }
+    return 0;
+}
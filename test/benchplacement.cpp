@@ -0,0 +1,147 @@
+// EventLoops::allocLoop 放置策略基准: 轮转时，活跃长连接因其间的短连接而堆积在同一个 sub loop 上，
+// 之后的轻负载连接测量 ping-pong 往返延迟的分布
+// 活跃连接的每条消息在 loop 中阻塞 300us (模拟同步的业务逻辑)，不占用 CPU，单核机器上结果同样有意义
+// 每种策略在独立的子进程中运行
+#include "miniduo/conn.h"
+#include "miniduo/EventLoop.h"
+#include "miniduo/net.h"
+#include "testutil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace miniduo;
+
+const int kSubLoops = 4;
+const int kHeavy = 8;
+const int kLight = 6;
+const int kPings = 300;
+const int kBasePort = 19310;
+
+typedef std::chrono::steady_clock Clock;
+
+// 发送 len 字节并等待同样长度的回显
+bool roundTrip(int fd, const char* msg, size_t len) {
+    if(::write(fd, msg, len) != static_cast<ssize_t>(len)) {
+        return false;
+    }
+    char buf[4096];
+    size_t got = 0;
+    while(got < len) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if(n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+void runPolicy(const char* name, EventLoops::PlacementPolicy policy, int port) {
+    EventLoops loops(kSubLoops);
+    loops.setPlacementPolicy(policy);
+    TcpServer server(&loops, SockAddr(port));
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMsgCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+        std::string msg = buf->retrieveAsString();
+        if(!msg.empty() && msg[0] == 'H') {
+            usleep(300);
+        }
+        conn->send(std::move(msg));
+    });
+    server.start();
+    std::thread loopThread([&loops] { loops.loop(); });
+    usleep(100 * 1000);
+
+    // 每个活跃连接之后跟 kSubLoops-1 个随即关闭的短连接
+    std::vector<int> heavyFds;
+    for(int i=0; i<kHeavy; i++) {
+        heavyFds.push_back(connectNoDelay(port));
+        usleep(2000);
+        std::vector<int> shortFds;
+        for(int j=0; j<kSubLoops-1; j++) {
+            shortFds.push_back(connectNoDelay(port));
+            usleep(2000);
+        }
+        for(int fd: shortFds) {
+            ::close(fd);
+        }
+    }
+    usleep(50 * 1000);
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> heavyThreads;
+    for(int fd: heavyFds) {
+        heavyThreads.emplace_back([fd, &stop] {
+            std::string msg(1024, 'H');
+            while(!stop && roundTrip(fd, msg.data(), msg.size())) {
+                usleep(1000);
+            }
+        });
+    }
+
+    std::vector<std::vector<double>> rtts(kLight);
+    std::vector<int> lightFds;
+    for(int i=0; i<kLight; i++) {
+        lightFds.push_back(connectNoDelay(port));
+        usleep(2000);
+    }
+    std::vector<std::thread> lightThreads;
+    for(int i=0; i<kLight; i++) {
+        lightThreads.emplace_back([i, &rtts, &lightFds] {
+            const char msg[32] = "ping";
+            for(int k=0; k<kPings; k++) {
+                auto start = Clock::now();
+                if(!roundTrip(lightFds[i], msg, sizeof msg)) {
+                    break;
+                }
+                rtts[i].push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+                usleep(500);
+            }
+        });
+    }
+    for(auto& t: lightThreads) {
+        t.join();
+    }
+    stop = true;
+    for(auto& t: heavyThreads) {
+        t.join();
+    }
+
+    std::vector<int> perLoop;
+    for(EventLoop* loop: loops.ioLoops()) {
+        perLoop.push_back(loop->connectionLoad());
+    }
+    std::vector<double> all;
+    for(auto& v: rtts) {
+        all.insert(all.end(), v.begin(), v.end());
+    }
+    std::sort(all.begin(), all.end());
+    printf("%-18s conns per loop [%d %d %d %d]  light rtt p50 %7.1f us  p99 %7.1f us  max %7.1f us\n",
+           name, perLoop[0], perLoop[1], perLoop[2], perLoop[3],
+           all[all.size() / 2], all[all.size() * 99 / 100], all.back());
+    fflush(stdout);
+    // 不析构 TcpServer / EventLoops, 直接结束子进程
+    _exit(0);
+}
+
+int main() {
+    struct {
+        const char* name;
+        EventLoops::PlacementPolicy policy;
+    } policies[] = {
+        {"RoundRobin", EventLoops::PlacementPolicy::kRoundRobin},
+        {"LeastConnections", EventLoops::PlacementPolicy::kLeastConnections},
+        {"LeastPendingBytes", EventLoops::PlacementPolicy::kLeastPendingBytes},
+        {"PowerOfTwoChoices", EventLoops::PlacementPolicy::kPowerOfTwoChoices},
+    };
+    runModes(policies, kBasePort, [](const auto& p, int port) {
+        runPolicy(p.name, p.policy, port);
+    });
+    return 0;
+}
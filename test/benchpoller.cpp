@@ -0,0 +1,107 @@
+// poller 注册表微基准: 在 10k / 100k 个已注册 channel 下
+// 测量 addChannel / updateChannel / removeChannel 的单次开销
+// channel 不关注任何事件，因此不会触发 epoll_ctl / io_uring 提交，只测量表的查找开销
+#include "miniduo/EventLoop.h"
+#include "miniduo/poller.h"
+#include "miniduo/channel.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
+#include <stdio.h>
+
+using namespace miniduo;
+
+const int kFdBase = 1 << 12; // 避开进程中真实的 fd
+const int kRounds = 10;
+volatile long g_sink; // 防止查找被优化掉
+
+double nsPerOp(std::chrono::steady_clock::time_point start, long ops) {
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / ops;
+}
+
+void benchPoller(const char* name, BasePoller* poller, EventLoop* loop, int count) {
+    std::vector<std::unique_ptr<Channel>> channels;
+    channels.reserve(count);
+    for(int i=0; i<count; i++) {
+        channels.emplace_back(new Channel(loop, kFdBase + i));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(auto& ch: channels) {
+        poller->addChannel(ch.get());
+    }
+    double addNs = nsPerOp(start, count);
+
+    start = std::chrono::steady_clock::now();
+    for(int r=0; r<kRounds; r++) {
+        for(auto& ch: channels) {
+            poller->updateChannel(ch.get());
+        }
+    }
+    double updateNs = nsPerOp(start, static_cast<long>(count) * kRounds);
+
+    start = std::chrono::steady_clock::now();
+    for(auto& ch: channels) {
+        poller->removeChannel(ch.get());
+    }
+    double removeNs = nsPerOp(start, count);
+
+    printf("%-13s %7d channels: add %7.1f ns  update %7.1f ns  remove %7.1f ns\n",
+           name, count, addNs, updateNs, removeNs);
+}
+
+// 与改动前 std::map<int, std::pair<Channel*, ChannelState>> 的查找模式对比
+void benchStdMap(int count) {
+    std::map<int, std::pair<Channel*, int>> channels;
+    auto start = std::chrono::steady_clock::now();
+    for(int i=0; i<count; i++) {
+        channels[kFdBase + i] = {nullptr, 0};
+    }
+    double addNs = nsPerOp(start, count);
+
+    start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for(int r=0; r<kRounds; r++) {
+        for(int i=0; i<count; i++) {
+            const int fd = kFdBase + i;
+            // EPollPoller::updateChannel 旧实现: find + 2 次 operator[]
+            if(channels.find(fd) != channels.end()
+               && channels[fd].first == nullptr) {
+                sum += channels[fd].second;
+            }
+        }
+    }
+    double updateNs = nsPerOp(start, static_cast<long>(count) * kRounds);
+
+    start = std::chrono::steady_clock::now();
+    for(int i=0; i<count; i++) {
+        channels.erase(kFdBase + i);
+    }
+    double removeNs = nsPerOp(start, count);
+    g_sink = sum;
+    printf("%-13s %7d channels: add %7.1f ns  update %7.1f ns  remove %7.1f ns\n",
+           "std::map", count, addNs, updateNs, removeNs);
+}
+
+int main() {
+    EventLoop loop;
+    loop.runInLoop([&loop] {
+        for(int count: {10000, 100000}) {
+            benchStdMap(count);
+            PollPoller pollPoller(&loop);
+            benchPoller("PollPoller", &pollPoller, &loop, count);
+            EPollPoller epollPoller(&loop);
+            benchPoller("EPollPoller", &epollPoller, &loop, count);
+            if(IoUringPoller::supported()) {
+                IoUringPoller uringPoller(&loop);
+                benchPoller("IoUringPoller", &uringPoller, &loop, count);
+            }
+        }
+        loop.quit();
+    });
+    loop.loop();
+    return 0;
+}
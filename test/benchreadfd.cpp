@@ -0,0 +1,78 @@
+// Buffer::readFd 与 Buffer::readFdDirect 接收大消息的吞吐:
+// 另一个线程经 socketpair 连续写入 1 MiB 的消息，读端收齐一条消息后取出
+// readFd 超出可写空间的部分先读入 64 KiB 的栈上 extrabuf 再 append，readFdDirect 直接读入 buffer
+#include "miniduo/buffer.h"
+#include "testutil.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace miniduo;
+
+const size_t kMsgSize = 1 << 20;
+const int kMsgs = 512;
+
+typedef std::chrono::steady_clock Clock;
+
+void run(const char* name, bool direct) {
+    int fds[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    int sndbuf = 1 << 20;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf);
+    std::thread writer([fds] {
+        std::string msg(kMsgSize, 'm');
+        for(int i=0; i<kMsgs; i++) {
+            msg[0] = static_cast<char>(i);
+            size_t sent = 0;
+            while(sent < msg.size()) {
+                ssize_t n = ::write(fds[0], msg.data() + sent, msg.size() - sent);
+                if(n <= 0) {
+                    return;
+                }
+                sent += n;
+            }
+        }
+    });
+
+    Buffer buf;
+    size_t minWritable = Buffer::kInitialSize;
+    int savedErrno = 0;
+    int msgs = 0;
+    size_t reads = 0;
+    auto start = Clock::now();
+    while(msgs < kMsgs) {
+        ssize_t n = direct ? buf.readFdDirect(fds[1], minWritable, &savedErrno)
+                           : buf.readFd(fds[1], &savedErrno);
+        if(n <= 0) {
+            break;
+        }
+        reads++;
+        // 与 TcpConnection::readInput() 相同的预测
+        if(direct && static_cast<size_t>(n) >= minWritable && minWritable < 65536) {
+            minWritable *= 2;
+        }
+        while(buf.readableBytes() >= kMsgSize) {
+            check(buf.beginRead()[0] == static_cast<char>(msgs), "message order");
+            buf.retrieve(kMsgSize);
+            msgs++;
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    writer.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+    check(msgs == kMsgs, "all messages received");
+    printf("%-14s %d x 1 MiB  %7.1f ms  %7.1f MiB/s  %6.1f KiB/read\n",
+           name, msgs, ms, msgs / (ms / 1000), msgs * 1024.0 / reads);
+}
+
+int main() {
+    run("readFd", false);
+    run("readFdDirect", true);
+    printf("%s\n", g_ok ? "all passed" : "FAILED");
+    return g_ok ? 0 : 1;
+}
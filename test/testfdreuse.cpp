@@ -0,0 +1,77 @@
+// fd 在 poll 未完成时被关闭并复用: 旧 channel 的 completion 已经进入 completion ring
+// (或在移除时被 cancel) 但尚未收割，同一个 fd 上新注册的 channel 不应被它触发
+// 新 channel 在数据到达前不应收到读事件，数据到达后正常收到
+#include "miniduo/EventLoop.h"
+#include "miniduo/channel.h"
+#include "testutil.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace miniduo;
+
+int main() {
+    EventLoop loop;
+    int oldPipe[2];
+    int newPipe[2];
+    if(::pipe2(oldPipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+        perror("pipe2");
+        return 1;
+    }
+    Channel oldChannel(&loop, oldPipe[0]);
+    oldChannel.setReadCallback([](Timestamp) {
+        check(false, "old channel never fires");
+    });
+    loop.addChannel(&oldChannel);
+    oldChannel.enableReading(true);
+
+    int spurious = 0;
+    int reads = 0;
+    Channel* newChannel = nullptr;
+    // 第一轮 poll 提交了旧 channel 的 POLL_ADD 之后
+    loop.runAfter(0.05, [&] {
+        // 旧 poll 完成，completion 留在 ring 中等下一轮 poll 收割
+        ::write(oldPipe[1], "x", 1);
+        oldChannel.disableAll();
+        loop.removeChannel(&oldChannel);
+        ::close(oldPipe[0]);
+        ::close(oldPipe[1]);
+        // 最小的空闲 fd 即刚关闭的 fd
+        if(::pipe2(newPipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+            perror("pipe2");
+            exit(1);
+        }
+        check(newPipe[0] == oldPipe[0], "fd reused");
+        newChannel = new Channel(&loop, newPipe[0]);
+        newChannel->setReadCallback([&](Timestamp) {
+            char buf[16];
+            if(::read(newPipe[0], buf, sizeof buf) > 0) {
+                reads++;
+            }
+            else {
+                spurious++;
+            }
+        });
+        loop.addChannel(newChannel);
+        newChannel->enableReading(true);
+    });
+    loop.runAfter(0.2, [&] {
+        check(spurious == 0 && reads == 0, "no event before data arrives");
+        ::write(newPipe[1], "y", 1);
+    });
+    loop.runAfter(0.35, [&] {
+        check(reads == 1, "event after data arrives");
+        newChannel->disableAll();
+        loop.removeChannel(newChannel);
+        loop.quit();
+    });
+    loop.loop();
+    delete newChannel;
+    ::close(newPipe[0]);
+    ::close(newPipe[1]);
+    printf("%s: %d spurious events, %d reads  %s\n",
+           loop.ioUringPoller() != nullptr ? "io_uring" : "poll/epoll", spurious, reads,
+           g_ok ? "OK" : "FAILED");
+    return g_ok ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+// SmallFunction: 小捕获不分配堆内存，可捕获只可移动的对象，大捕获退化为一次堆分配；
+// 跨线程 queueInLoop 小捕获的任务在队列节点循环使用后同样不分配
+#include "miniduo/EventLoop.h"
+#include "miniduo/function.h"
+
+#include <assert.h>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+using namespace miniduo;
+
+static std::atomic<long> g_allocs(0);
+
+void* operator new(size_t size) {
+    g_allocs++;
+    void* p = malloc(size);
+    if(p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// 另一个线程逐个 queueInLoop 并等待执行，预热后统计期间的分配次数
+long queueInLoopAllocations() {
+    const int kWarmup = 1000;
+    const int kTasks = 10000;
+    EventLoop loop;
+    std::atomic<int> done(0);
+    long allocs = -1;
+    std::thread producer([&] {
+        long before = 0;
+        for(int i=0; i<kWarmup + kTasks; i++) {
+            if(i == kWarmup) {
+                before = g_allocs;
+            }
+            loop.queueInLoop([&done] { done++; });
+            while(done != i + 1) {
+                std::this_thread::yield();
+            }
+        }
+        allocs = g_allocs - before;
+        loop.queueInLoop([&loop] { loop.quit(); });
+    });
+    loop.loop();
+    producer.join();
+    printf("queueInLoop from another thread: %ld allocations for %d tasks\n", allocs, kTasks);
+    return allocs;
+}
+
+int main() {
+    int counter = 0;
+    void* self = &counter;
+
+    long before = g_allocs;
+    SmallFunction<void()> small([&counter, self] { counter += (self != nullptr); });
+    SmallFunction<void()> moved(std::move(small));
+    moved();
+    assert(!small && moved);
+    printf("small capture: %ld allocations\n", g_allocs - before);
+    assert(g_allocs == before);
+
+    std::unique_ptr<int> owned(new int(41));
+    SmallFunction<int(int)> moveOnly([p = std::move(owned)](int x) { return *p + x; });
+    assert(moveOnly(1) == 42);
+
+    char big[128] = { 'x' };
+    before = g_allocs;
+    SmallFunction<char()> large([big] { return big[0]; });
+    printf("large capture: %ld allocations\n", g_allocs - before);
+    assert(large() == 'x' && g_allocs == before + 1);
+
+    std::function<void()> empty;
+    SmallFunction<void()> fromEmpty(empty);
+    assert(!fromEmpty);
+
+    const long queueAllocs = queueInLoopAllocations();
+    assert(queueAllocs == 0);
+
+    printf("counter %d\n", counter);
+    return counter == 1 ? 0 : 1;
+}
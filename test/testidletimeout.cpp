@@ -0,0 +1,148 @@
+// TcpServer::setIdleTimeout(): 不读写的连接在超时后被关闭，
+// 持续收发的连接、服务端持续发送而客户端只读的连接保持打开，停止收发后同样在超时后被关闭
+// level-triggered、edge-triggered 与 completion 模式各在独立的子进程中运行
+#include "miniduo/conn.h"
+#include "miniduo/EventLoop.h"
+#include "miniduo/net.h"
+#include "testutil.h"
+
+#include <atomic>
+#include <chrono>
+#include <poll.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace miniduo;
+
+const double kIdleTimeout = 0.3;
+const int kPushes = 10;
+const int kBasePort = 19810;
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// 等待对端关闭，返回等待的秒数，超过 limit 秒返回 -1
+double waitClosed(int fd, double limit) {
+    auto start = Clock::now();
+    char buf[64];
+    while(secondsSince(start) < limit) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if(::poll(&pfd, 1, 10) > 0 && ::read(fd, buf, sizeof buf) <= 0) {
+            return secondsSince(start);
+        }
+    }
+    return -1;
+}
+
+void runMode(const char* name, bool edgeTriggered, bool completionMode, int port) {
+    std::atomic<int> closed(0);
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread loopThread([&] {
+        EventLoop loop;
+        TcpServer server(&loop, SockAddr(port));
+        server.setCompletionMode(completionMode);
+        server.setEdgeTriggered(edgeTriggered);
+        server.setIdleTimeout(kIdleTimeout);
+        server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+            if(!conn->connected()) {
+                closed++;
+            }
+        });
+        // 收到 "p" 的连接由服务端每 100ms 发送一次，共 kPushes 次，其余回显
+        TcpConnectionPtr pusher;
+        int pushes = 0;
+        server.setMsgCallback([&](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+            std::string msg = buf->retrieveAsString();
+            if(msg == "p") {
+                pusher = conn;
+            }
+            else {
+                conn->send(msg);
+            }
+        });
+        loop.runEvery(0.1, [&] {
+            if(pusher) {
+                pusher->send(std::string("p"));
+                if(++pushes == kPushes) {
+                    // 不再持有连接，关闭后 socket 随连接析构
+                    pusher.reset();
+                }
+            }
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while(serverLoop == nullptr) {
+        usleep(1000);
+    }
+    usleep(100 * 1000);
+
+    int idleFd = connectTo(port);
+    int activeFd = connectTo(port);
+    int pushFd = connectTo(port);
+    ::write(pushFd, "p", 1);
+    auto start = Clock::now();
+    double idleClosedAt = -1;
+    bool activeOpen = true;
+    bool pushOpen = true;
+    int pushed = 0;
+    // 活跃连接每 100ms 收发一次，持续 1s
+    for(int i=0; i<10 && activeOpen; i++) {
+        activeOpen = ::write(activeFd, "a", 1) == 1;
+        char c;
+        pollfd pfd = { activeFd, POLLIN, 0 };
+        activeOpen = activeOpen && ::poll(&pfd, 1, 1000) > 0 && ::read(activeFd, &c, 1) == 1;
+        auto tickStart = Clock::now();
+        // 只读不写
+        char buf[64];
+        ssize_t n;
+        while((n = ::recv(pushFd, buf, sizeof buf, MSG_DONTWAIT)) > 0) {
+            pushed += n;
+        }
+        pushOpen = pushOpen && n < 0;
+        double waited = waitClosed(idleFd, idleClosedAt < 0 ? 0.1 : 0);
+        if(idleClosedAt < 0 && waited >= 0) {
+            idleClosedAt = secondsSince(start);
+        }
+        double rest = 0.1 - secondsSince(tickStart);
+        if(rest > 0) {
+            usleep(static_cast<useconds_t>(rest * 1000000));
+        }
+    }
+    check(activeOpen, "active connection stays open");
+    check(pushOpen && pushed >= kPushes - 2, "read-only connection stays open while the server sends");
+    check(idleClosedAt >= kIdleTimeout && idleClosedAt < kIdleTimeout + 0.3,
+          "idle connection closed after the timeout");
+    double activeClosedAfter = waitClosed(activeFd, 2);
+    check(activeClosedAfter >= kIdleTimeout - 0.01 && activeClosedAfter < kIdleTimeout + 0.3,
+          "connection closed after it stops sending");
+    check(waitClosed(pushFd, 2) >= 0, "read-only connection closed after the server stops sending");
+    usleep(50 * 1000);
+    check(closed == 3, "connection callbacks");
+    printf("%-16s idle closed after %.2fs, active closed %.2fs after last message, "
+           "read-only got %d pushes  %s\n",
+           name, idleClosedAt, activeClosedAfter, pushed, g_ok ? "OK" : "FAILED");
+    exitChild();
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool edgeTriggered;
+        bool completionMode;
+    } modes[] = {
+        {"level-triggered", false, false},
+        {"edge-triggered", true, false},
+        {"completion", false, true},
+    };
+    int failed = runModes(modes, kBasePort, [](const auto& m, int port) {
+        runMode(m.name, m.edgeTriggered, m.completionMode, port);
+    });
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+// 编译期最低级别与按模块的运行时级别
+// 本文件以 MINIDUO_LOG_MIN_LEVEL=2 编译: log_trace 被去掉，参数不求值
+// 子进程中把 HTTP 设为 TRACE、NET 设为 WARN, 检查输出的日志行;
+// 之后测量被运行时关闭的调用 (NET 的 DEBUG) 与被编译期去掉的调用的耗时
+#define MINIDUO_LOG_MIN_LEVEL 2
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "miniduo/logging.h"
+#include "miniduo/http/httpmsg.h" // http_log
+#include "testutil.h"
+
+typedef std::chrono::steady_clock Clock;
+
+int g_evaluated = 0;
+
+int touch(int v) {
+    g_evaluated++;
+    return v;
+}
+
+void logNet() {
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::NET
+    log_debug("net debug %d", touch(1));
+    log_warn("net warn %d", touch(2));
+    streamlog_info << "net stream info " << touch(3);
+    streamlog_error << "net stream error " << touch(4);
+#undef MINIDUO_LOG_MODULE
+#define MINIDUO_LOG_MODULE Logger::LogModule::DEFAULT
+}
+
+void logHttp() {
+    http_log("parse %s", "GET"); // TRACE, 编译期去掉
+    log_module(Logger::LogModule::HTTP, Logger::LogLevel::DEBUG, "[DEBUG]", "http debug %d", touch(5));
+}
+
+void logDefault() {
+    log_trace("default trace %d", touch(6)); // 编译期去掉
+    log_info("default info %d", touch(7));
+}
+
+void checkLevels() {
+    char path[] = "/tmp/testloglevelXXXXXX";
+    int fd = mkstemp(path);
+    bool exited = runChild([fd] {
+        dup2(fd, 1);
+        set_logLevel(Logger::LogLevel::INFO);
+        set_logModuleLevel(Logger::LogModule::HTTP, Logger::LogLevel::TRACE);
+        set_logModuleLevel(Logger::LogModule::NET, Logger::LogLevel::WARN);
+        logNet();
+        logHttp();
+        logDefault();
+        // 被关闭或去掉的调用不求值参数: 只有 2, 4, 5, 7
+        int evaluated = g_evaluated;
+        log_warn("evaluated %d", evaluated);
+        exit(0); // 析构 Logger, 写出剩余的日志
+    });
+    check(exited, "child exit");
+
+    FILE* fp = fdopen(fd, "r");
+    rewind(fp);
+    std::string out;
+    char line[512];
+    while(fgets(line, sizeof line, fp) != nullptr) {
+        const char* p = strstr(line, "]: ");
+        out += p != nullptr ? p + 3 : line;
+    }
+    fclose(fp);
+    unlink(path);
+    const char* expect =
+        "net warn 2\n"
+        "net stream error 4\n"
+        "http debug 5\n"
+        "default info 7\n"
+        "evaluated 4\n";
+    check(out == expect, "module levels");
+    if(out != expect) {
+        printf("got:\n%s", out.c_str());
+    }
+    printf("module levels: %s", out == expect ? "OK\n" : "FAILED\n");
+}
+
+void benchDisabled() {
+    const int kCalls = 10000000;
+    set_logLevel(Logger::LogLevel::INFO);
+    set_logModuleLevel(Logger::LogModule::HTTP, Logger::LogLevel::TRACE);
+    g_evaluated = 0;
+    auto start = Clock::now();
+    for(int i=0; i<kCalls; i++) {
+        log_module(Logger::LogModule::NET, Logger::LogLevel::DEBUG, "[DEBUG]", "poll %d", touch(i));
+    }
+    double runtimeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    start = Clock::now();
+    for(int i=0; i<kCalls; i++) {
+        log_trace("poll %d", touch(i));
+    }
+    double compiledMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    check(g_evaluated == 0, "disabled calls evaluate no arguments");
+    printf("disabled log x %d: runtime level check %6.1f ms  compiled out %6.1f ms\n",
+           kCalls, runtimeMs, compiledMs);
+}
+
+int main() {
+    checkLevels();
+    benchDisabled();
+    printf("%s\n", g_ok ? "all passed" : "FAILED");
+    return g_ok ? 0 : 1;
+}
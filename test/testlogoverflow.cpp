@@ -0,0 +1,135 @@
+// 日志写得比产生慢时的 OverflowPolicy
+// 子进程的 stdout 是一个管道，父进程先不读，管道与线程缓冲区很快被写满;
+// 检查 BLOCK 不丢日志, DROP_NEWEST 丢弃并计数, DROP_BY_LEVEL 只丢弃 WARN 以下的日志,
+// 以及后台写入的丢弃说明与计数一致
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "miniduo/logging.h"
+#include "testutil.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const int kLines = 200000;
+const int kWarnEvery = 10;
+
+const char* policyName(Logger::OverflowPolicy policy) {
+    switch(policy) {
+    case Logger::OverflowPolicy::BLOCK: return "block";
+    case Logger::OverflowPolicy::DROP_NEWEST: return "drop-newest";
+    case Logger::OverflowPolicy::DROP_BY_LEVEL: return "drop-by-level";
+    }
+    return "";
+}
+
+void child(Logger::OverflowPolicy policy) {
+    set_logLevel(Logger::LogLevel::INFO);
+    Logger::getLogger().setOverflowPolicy(policy, Logger::LogLevel::WARN);
+    auto start = Clock::now();
+    for(int i=0; i<kLines; i++) {
+        if(i % kWarnEvery == 0) {
+            log_warn("storm warn %d", i);
+        }
+        else {
+            log_info("storm info %d", i);
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    set_logOverflowPolicy(Logger::OverflowPolicy::BLOCK);
+    log_warn("done %llu %llu %.0f",
+             static_cast<unsigned long long>(Logger::getLogger().droppedLines()),
+             static_cast<unsigned long long>(Logger::getLogger().droppedBytes()), ms);
+    exit(0); // 析构 Logger, 写出剩余的日志
+}
+
+void run(Logger::OverflowPolicy policy) {
+    int fds[2];
+    if(pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout); // 子进程不再输出父进程缓冲区中的内容
+    pid_t pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], 1);
+        close(fds[1]);
+        child(policy);
+    }
+    close(fds[1]);
+    // 先不读，让子进程的日志堆积
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    FILE* fp = fdopen(fds[0], "r");
+    int info = 0;
+    int warn = 0;
+    unsigned long long noticed = 0;
+    unsigned long long noticedBytes = 0;
+    unsigned long long dropped = 0;
+    unsigned long long droppedBytes = 0;
+    double ms = 0;
+    bool done = false;
+    int lastWarn = -1;
+    char line[512];
+    while(fgets(line, sizeof line, fp) != nullptr) {
+        const char* p = strstr(line, "]: ");
+        unsigned long long n = 0;
+        unsigned long long bytes = 0;
+        int i = 0;
+        if(p != nullptr && sscanf(p, "]: storm info %d", &i) == 1) {
+            info++;
+        }
+        else if(p != nullptr && sscanf(p, "]: storm warn %d", &i) == 1) {
+            check(i > lastWarn, "warn lines in order");
+            lastWarn = i;
+            warn++;
+        }
+        else if(p != nullptr && sscanf(p, "]: done %llu %llu %lf", &dropped, &droppedBytes, &ms) == 3) {
+            done = true;
+        }
+        else if((p = strstr(line, "[logging] ")) != nullptr
+                && sscanf(p, "[logging] %llu log lines (%llu bytes) dropped", &n, &bytes) == 2) {
+            noticed += n;
+            noticedBytes += bytes;
+        }
+        else {
+            check(false, "unexpected line");
+            printf("  %s", line);
+        }
+    }
+    fclose(fp);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "child exit");
+    check(done, "final line written");
+    check(noticed == dropped && noticedBytes == droppedBytes, "drop notices match counters");
+    check(info + warn + dropped == static_cast<unsigned long long>(kLines), "lines written or dropped");
+    switch(policy) {
+    case Logger::OverflowPolicy::BLOCK:
+        check(dropped == 0, "block drops nothing");
+        break;
+    case Logger::OverflowPolicy::DROP_NEWEST:
+        check(dropped > 0, "drop-newest drops under overload");
+        break;
+    case Logger::OverflowPolicy::DROP_BY_LEVEL:
+        check(dropped > 0, "drop-by-level drops under overload");
+        check(warn == kLines / kWarnEvery, "drop-by-level keeps all warnings");
+        break;
+    }
+    printf("%-13s %6d info %6d warn  %6llu dropped (%llu bytes)  logging took %5.0f ms  %s\n",
+           policyName(policy), info, warn, dropped, droppedBytes, ms, g_ok ? "OK" : "FAILED");
+}
+
+int main() {
+    for(auto policy: {Logger::OverflowPolicy::BLOCK, Logger::OverflowPolicy::DROP_NEWEST,
+                      Logger::OverflowPolicy::DROP_BY_LEVEL}) {
+        run(policy);
+    }
+    printf("%s\n", g_ok ? "all passed" : "FAILED");
+    return g_ok ? 0 : 1;
+}
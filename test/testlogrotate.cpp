@@ -0,0 +1,179 @@
+// 按大小切换日志文件，后台压缩与保留上限
+// 子进程在临时目录中以 64 KiB 为上限写约 4 MiB 的日志; 父进程检查:
+// 保留的文件数或字节数不超过上限，关闭的文件都已压缩 (有 zlib 时)，
+// 按文件名顺序读出的日志行连续并以最后一行结束
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifdef MINIDUO_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "miniduo/logarchiver.h" // compressionSupported()
+#include "miniduo/logging.h"
+#include "testutil.h"
+
+const int kLines = 40000;
+const size_t kRotateSize = 64 * 1024;
+
+bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+std::vector<std::string> listLogs(const char* dir) {
+    std::vector<std::string> names;
+    if(DIR* d = opendir(dir)) {
+        while(struct dirent* entry = readdir(d)) {
+            if(strncmp(entry->d_name, "rot.", 4) == 0) {
+                names.push_back(entry->d_name);
+            }
+        }
+        closedir(d);
+    }
+    return names;
+}
+
+// 与 LogArchiver 相同的顺序: 去掉 .gz 后按 (时间, 同一秒内的序号)
+std::pair<std::string, long> sortKey(std::string name) {
+    if(endsWith(name, ".gz")) {
+        name.resize(name.size() - 3);
+    }
+    size_t dot = name.rfind('.');
+    if(name.find_first_not_of("0123456789", dot + 1) != std::string::npos) {
+        return std::make_pair(name, 0L);
+    }
+    return std::make_pair(name.substr(0, dot), atol(name.c_str() + dot + 1));
+}
+
+std::string readLog(const std::string& path) {
+    std::string data;
+    char buf[65536];
+#ifdef MINIDUO_HAVE_ZLIB
+    gzFile in = gzopen(path.c_str(), "rb"); // 也能读未压缩的文件
+    int n = 0;
+    while(in != nullptr && (n = gzread(in, buf, sizeof buf)) > 0) {
+        data.append(buf, n);
+    }
+    if(in != nullptr) {
+        gzclose(in);
+    }
+#else
+    FILE* fp = fopen(path.c_str(), "rb");
+    size_t n = 0;
+    while(fp != nullptr && (n = fread(buf, 1, sizeof buf, fp)) > 0) {
+        data.append(buf, n);
+    }
+    if(fp != nullptr) {
+        fclose(fp);
+    }
+#endif
+    return data;
+}
+
+void child(bool compress, size_t maxFiles, size_t maxBytes) {
+    set_logLevel(Logger::LogLevel::INFO);
+    set_logName("rot");
+    set_logRotateSize(kRotateSize);
+    bool compressed = set_logCompress(compress);
+    set_logRetention(maxFiles, maxBytes);
+    set_logSwitchToFileLog();
+    for(int i=0; i<kLines; i++) {
+        log_info("rotate %d ........................................................", i);
+    }
+    // 等后台压缩完关闭的文件: 只剩正在写的文件没有压缩
+    for(int wait=0; wait<100; wait++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        int plain = 0;
+        for(auto& name: listLogs("log")) {
+            plain += !endsWith(name, ".gz");
+        }
+        if(!compressed || plain <= 1) {
+            break;
+        }
+    }
+    exit(0);
+}
+
+void run(bool compress, size_t maxFiles, size_t maxBytes) {
+    char dir[] = "/tmp/testlogrotateXXXXXX";
+    if(mkdtemp(dir) == nullptr || chdir(dir) < 0) {
+        perror(dir);
+        exit(1);
+    }
+    bool exited = runChild([=] { child(compress, maxFiles, maxBytes); });
+    check(exited, "child exit");
+
+    std::vector<std::string> names = listLogs("log");
+    std::sort(names.begin(), names.end(), [](const std::string& a, const std::string& b) {
+        return sortKey(a) < sortKey(b);
+    });
+    check(names.size() >= 2, "rotated by size");
+    int gz = 0;
+    size_t closedBytes = 0;
+    size_t maxPlain = 0;
+    std::string all;
+    for(size_t i = 0; i < names.size(); i++) {
+        std::string path = std::string("log/") + names[i];
+        struct stat st;
+        stat(path.c_str(), &st);
+        std::string data = readLog(path);
+        if(i + 1 < names.size()) {
+            closedBytes += st.st_size;
+            gz += endsWith(names[i], ".gz");
+            maxPlain = std::max(maxPlain, data.size());
+        }
+        all += data;
+        unlink(path.c_str());
+    }
+    rmdir("log");
+    chdir("/tmp");
+    rmdir(dir);
+
+    const size_t closed = names.empty() ? 0 : names.size() - 1;
+    if(maxFiles > 0) {
+        check(closed <= maxFiles, "file retention");
+    }
+    if(maxBytes > 0) {
+        check(closedBytes <= maxBytes, "byte retention");
+    }
+    if(compress && LogArchiver::compressionSupported()) {
+        check(gz == static_cast<int>(closed), "closed files compressed");
+    }
+    // 切换在后台每批写出之前检查，单个线程写日志时一批不超过它的缓冲区 (128 KiB)
+    check(maxPlain <= kRotateSize + 128 * 1024, "file size bound");
+
+    // 保留的日志是连续的一段，以最后一行结束
+    int first = -1;
+    int expect = -1;
+    bool contiguous = true;
+    for(const char* p = all.c_str(); (p = strstr(p, "]: rotate ")) != nullptr; p++) {
+        int i = atoi(p + 10);
+        if(first < 0) {
+            first = expect = i;
+        }
+        contiguous = contiguous && i == expect;
+        expect = i + 1;
+    }
+    check(contiguous && expect == kLines, "retained lines contiguous up to the last");
+    printf("compress %d retention %zu files %zu bytes: %zu closed (%d gz, %zu bytes, largest %zu KiB), lines %d..%d  %s\n",
+           compress, maxFiles, maxBytes, closed, gz, closedBytes, maxPlain / 1024, first, expect - 1,
+           g_ok ? "OK" : "FAILED");
+}
+
+int main() {
+    run(true, 6, 0);
+    run(false, 0, 512 * 1024);
+    printf("%s\n", g_ok ? "all passed" : "FAILED");
+    return g_ok ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+// 多个线程并发 queueInLoop，检查任务全部执行且同一生产者的任务保持 FIFO，
+// 并输出 eventfd 唤醒合并的统计
+#include "miniduo/EventLoop.h"
+
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+using namespace miniduo;
+
+const int kProducers = 8;
+const int kTasksPerProducer = 200000;
+
+int main() {
+    EventLoop loop;
+    std::vector<int> lastSeq(kProducers, -1);
+    long executed = 0;
+    bool ordered = true;
+
+    std::vector<std::thread> producers;
+    for(int p=0; p<kProducers; p++) {
+        producers.emplace_back([&, p] {
+            for(int i=0; i<kTasksPerProducer; i++) {
+                loop.queueInLoop([&, p, i] {
+                    if(lastSeq[p] + 1 != i) {
+                        ordered = false;
+                    }
+                    lastSeq[p] = i;
+                    if(++executed == static_cast<long>(kProducers) * kTasksPerProducer) {
+                        loop.quit();
+                    }
+                });
+            }
+        });
+    }
+    loop.loop();
+    for(auto& t: producers) {
+        t.join();
+    }
+
+    EventLoop::TaskQueueStats stats = loop.taskQueueStats();
+    printf("executed %ld tasks, per-producer order %s\n", executed, ordered ? "kept" : "BROKEN");
+    printf("tasks run %lu, eventfd wakeups %lu, coalesced %lu, max batch %lu\n",
+           stats.tasksRun, stats.wakeups, stats.coalescedWakeups, stats.maxBatch);
+    return ordered ? 0 : 1;
+}
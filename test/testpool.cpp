@@ -0,0 +1,80 @@
+// ComputePool: 结果回调在 loop 线程中执行，同一 key 的任务及回调保持提交顺序，
+// worker 内部提交的任务可被其他 worker 窃取
+#include "miniduo/EventLoop.h"
+#include "miniduo/threadpool.h"
+
+#include <atomic>
+#include <vector>
+#include <stdio.h>
+
+using namespace miniduo;
+
+const int kKeys = 16;
+const int kTasksPerKey = 2000;
+const int kFanout = 1000;
+
+long burn(int n) {
+    long sum = 0;
+    for(int i=0; i<n; i++) {
+        sum += i * i % 7;
+    }
+    return sum;
+}
+
+int main() {
+    EventLoop loop;
+    ComputePool pool(4);
+    pool.start();
+
+    std::vector<int> workSeq(kKeys, -1);  // 只由 key 对应的 worker 访问
+    std::vector<int> doneSeq(kKeys, -1);  // 只由 loop 线程访问
+    bool ordered = true;
+    bool inLoop = true;
+    int done = 0;
+    std::atomic<int> fanoutDone(0);
+    const int total = kKeys * kTasksPerKey;
+
+    loop.runAfter(0.01, [&] {
+        for(int i=0; i<kTasksPerKey; i++) {
+            for(int key=0; key<kKeys; key++) {
+                pool.submit(key, &loop,
+                    [&, key, i] {
+                        if(workSeq[key] + 1 != i) {
+                            ordered = false;
+                        }
+                        workSeq[key] = i;
+                        return burn(100 + i % 50) + i;
+                    },
+                    [&, key, i](long result) {
+                        inLoop = inLoop && loop.isInLoopThread();
+                        if(doneSeq[key] + 1 != i) {
+                            ordered = false;
+                        }
+                        doneSeq[key] = i;
+                        (void) result;
+                        if(++done == total) {
+                            loop.quit();
+                        }
+                    });
+            }
+        }
+        // 一个任务在 worker 中展开出大量子任务，空闲 worker 窃取执行
+        pool.submit([&] {
+            for(int i=0; i<kFanout; i++) {
+                pool.submit([&] {
+                    burn(2000);
+                    fanoutDone++;
+                });
+            }
+        });
+    });
+    loop.loop();
+    pool.stop();
+
+    ComputePool::Stats stats = pool.stats();
+    printf("done %d/%d, order %s, callbacks in loop %s, fanout %d/%d\n",
+           done, total, ordered ? "kept" : "BROKEN", inLoop ? "yes" : "NO",
+           fanoutDone.load(), kFanout);
+    printf("executed %lu tasks, stolen %lu\n", stats.executed, stats.stolen);
+    return ordered && inLoop && fanoutDone == kFanout ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+// TcpConnection::sendv: 自有 / 借用 / 共享片段与 send() 及 send(PayloadPtr) 交替发送，
+// 客户端慢速读取使 writev 多次部分写出，检查收到的字节流与发送顺序一致
+// 以及 MSG_ZEROCOPY 模式下检查共享片段在完成通知后被释放，
+// writeCompleteCallback 在完成通知之后 (回调时连接已不再持有片段)
+// 每种模式在独立的子进程中运行
+#include "miniduo/conn.h"
+#include "miniduo/EventLoop.h"
+#include "miniduo/net.h"
+#include "testutil.h"
+
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace miniduo;
+
+const int kBasePort = 19410;
+
+std::string pattern(size_t len, int seed) {
+    std::string s(len, '\0');
+    for(size_t i=0; i<len; i++) {
+        s[i] = static_cast<char>(i * 131 + seed);
+    }
+    return s;
+}
+
+// 借用片段的数据在整个进程生命周期内有效
+const std::string g_borrowed = pattern(1 << 20, 1);
+
+void runMode(const char* name, bool edgeTriggered, size_t zeroCopyThreshold, int port) {
+    const std::string header = pattern(100, 2);
+    const std::string body = pattern(300 * 1000, 3);
+    const std::string middle = pattern(5000, 4);
+    auto shared = std::make_shared<const std::string>(pattern(200 * 1000, 5));
+    const std::string expected = header + g_borrowed + body + middle
+                               + *shared + std::string("tail") + *shared + *shared;
+    // 最后一次 writeCompleteCallback 时共享片段的引用计数
+    std::atomic<long> useCountAtComplete(0);
+
+    std::thread loopThread([&] {
+        EventLoop loop;
+        TcpServer server(&loop, SockAddr(port));
+        server.setEdgeTriggered(edgeTriggered);
+        server.setZeroCopyThreshold(zeroCopyThreshold);
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setWriteCompleteCallback([&](const TcpConnectionPtr&) {
+            useCountAtComplete = shared.use_count();
+        });
+        server.setMsgCallback([&](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+            buf->retrieveAll();
+            std::vector<Slice> first;
+            first.emplace_back(std::string(header));
+            first.emplace_back(g_borrowed.data(), g_borrowed.size());
+            first.emplace_back(std::string(body));
+            conn->sendv(std::move(first));
+            conn->send(middle);
+            std::vector<Slice> second;
+            second.emplace_back(shared);
+            second.emplace_back(std::string("tail"));
+            second.emplace_back(shared);
+            conn->sendv(std::move(second));
+            conn->send(shared);
+        });
+        server.start();
+        loop.loop();
+    });
+    usleep(100 * 1000);
+
+    int fd = connectTo(port, 4096);
+    ::write(fd, "go", 2);
+    std::string received;
+    char buf[8192];
+    while(received.size() < expected.size()) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if(n <= 0) {
+            break;
+        }
+        received.append(buf, n);
+        if(received.size() % 16 == 0) {
+            usleep(50); // 慢速读取，服务端发送缓冲区写满后部分写出
+        }
+    }
+    check(received == expected, "byte stream in send order");
+    // 连接不再持有已发送的共享片段 (zerocopy 模式下等待完成通知)
+    for(int i=0; i<100 && (shared.use_count() > 1 || useCountAtComplete != 1); i++) {
+        usleep(1000);
+    }
+    check(shared.use_count() == 1, "shared slice released");
+    if(useCountAtComplete != 1) {
+        printf("writeComplete while the connection still holds %ld slices\n",
+               useCountAtComplete.load() - 1);
+        g_ok = false;
+    }
+    printf("%-16s received %zu / %zu bytes  %s\n",
+           name, received.size(), expected.size(), g_ok ? "OK" : "FAILED");
+    exitChild();
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool edgeTriggered;
+        size_t zeroCopyThreshold;
+    } modes[] = {
+        {"level-triggered", false, 0},
+        {"edge-triggered", true, 0},
+        {"zerocopy", false, 64 * 1024},
+        {"zerocopy ET", true, 64 * 1024},
+    };
+    int failed = runModes(modes, kBasePort, [](const auto& m, int port) {
+        runMode(m.name, m.edgeTriggered, m.zeroCopyThreshold, port);
+    });
+    return failed == 0 ? 0 : 1;
+}
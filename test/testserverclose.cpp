@@ -0,0 +1,101 @@
+// 在 loop 运行时析构 TcpServer: reusePort 模式下 acceptor 与连接表在各 sub loop 中清理
+// 检查析构后客户端连接被关闭，新的连接被拒绝，sub loop 继续正常运行 (定时器照常触发)
+#include "miniduo/conn.h"
+#include "miniduo/EventLoop.h"
+#include "miniduo/net.h"
+#include "testutil.h"
+
+#include <atomic>
+#include <memory>
+#include <poll.h>
+#include <stdio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace miniduo;
+
+const int kPort = 19760;
+const int kLoops = 4;
+const int kClients = 16;
+
+// 等待对端关闭，返回是否在 timeoutMs 内读到 EOF
+bool waitEof(int fd, int timeoutMs) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    char buf[64];
+    while(::poll(&pfd, 1, timeoutMs) > 0) {
+        ssize_t n = ::read(fd, buf, sizeof buf);
+        if(n <= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main() {
+    std::atomic<int> established(0);
+    std::atomic<int> ticks(0);
+    std::atomic<bool> destroyed(false);
+    std::atomic<EventLoops*> serverLoop(nullptr);
+    std::thread loopThread([&] {
+        EventLoops loop(kLoops);
+        std::unique_ptr<TcpServer> server(new TcpServer(&loop, SockAddr(kPort)));
+        server->setReusePort(true);
+        server->setConnectionCallback([&](const TcpConnectionPtr& conn) {
+            if(conn->connected()) {
+                established++;
+            }
+        });
+        server->setMsgCallback([](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+            conn->send(buf->retrieveAsString());
+        });
+        server->start();
+        // 析构后 sub loop 仍在处理定时器
+        for(EventLoop* ioLoop: loop.ioLoops()) {
+            ioLoop->runEvery(0.05, [&] { ticks++; });
+        }
+        serverLoop = &loop;
+        loop.runEvery(0.01, [&] {
+            if(established == kClients && server) {
+                server.reset();
+                destroyed = true;
+            }
+        });
+        loop.loop();
+    });
+    while(serverLoop == nullptr) {
+        usleep(1000);
+    }
+    usleep(100 * 1000);
+
+    std::vector<int> clients;
+    for(int i=0; i<kClients; i++) {
+        int fd = tryConnect(kPort);
+        check(fd >= 0, "connect");
+        clients.push_back(fd);
+    }
+    for(int wait=0; wait<200 && !destroyed; wait++) {
+        usleep(10 * 1000);
+    }
+    check(destroyed, "server destroyed");
+    int closed = 0;
+    for(int fd: clients) {
+        closed += waitEof(fd, 1000);
+        ::close(fd);
+    }
+    check(closed == kClients, "connections closed");
+    int fd = tryConnect(kPort);
+    check(fd < 0, "listeners closed");
+    if(fd >= 0) {
+        ::close(fd);
+    }
+    int before = ticks;
+    usleep(200 * 1000);
+    check(ticks > before, "sub loops keep running");
+
+    serverLoop.load()->quit();
+    loopThread.join();
+    printf("reusePort %d loops: %d connections, %d closed by ~TcpServer  %s\n",
+           kLoops, kClients, closed, g_ok ? "OK" : "FAILED");
+    return g_ok ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+// 比较阻塞模式与自旋模式下跨线程 queueInLoop 的唤醒延迟，并输出自旋/阻塞时间统计
+#include "miniduo/EventLoop.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+using namespace miniduo;
+
+const int kRounds = 2000;
+
+typedef std::chrono::steady_clock Clock;
+
+void measure(int spinUs) {
+    EventLoop loop;
+    loop.setSpinBudget(spinUs);
+    loop.setCpuAffinity(0);
+    std::thread t([&loop] { loop.loop(); });
+
+    std::vector<double> latencies;
+    latencies.reserve(kRounds);
+    for(int i=0; i<kRounds; i++) {
+        std::atomic<bool> done(false);
+        Clock::time_point sent = Clock::now();
+        Clock::time_point ran;
+        loop.queueInLoop([&] {
+            ran = Clock::now();
+            done = true;
+        });
+        while(!done) {
+            std::this_thread::yield();
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(ran - sent).count());
+        // 让 loop 耗尽自旋预算后进入阻塞
+        std::this_thread::sleep_for(std::chrono::microseconds(i % 2 ? 20 : 500));
+    }
+    loop.quit();
+    t.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    EventLoop::SpinStats stats = loop.spinStats();
+    printf("spin %4d us: p50 %6.1f us  p99 %6.1f us | spin %6.1f ms  sleep %6.1f ms  hits %lu  sleeps %lu\n",
+           spinUs, latencies[kRounds / 2], latencies[kRounds * 99 / 100],
+           stats.spinNs / 1e6, stats.sleepNs / 1e6, stats.spinHits, stats.sleeps);
+}
+
+int main() {
+    measure(0);
+    measure(100);
+    measure(1000);
+    return 0;
+}
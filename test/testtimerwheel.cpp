@@ -0,0 +1,214 @@
+// TimerWheel: 逐 tick 推进，检查随机加入、刷新、取消的定时器都恰好在到期 tick 运行；
+// 只在 nextEventTime() 推进 (与 timerfd 相同) 时同样恰好运行，且唤醒次数远少于 tick 数；
+// 并比较 10 万个连接超时反复刷新时 runAfter + cancel 与 addWheelTimer 的耗时
+// <random> 需要在 logging.h 的 log 宏之前包含
+#include <chrono>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "miniduo/EventLoop.h"
+#include "miniduo/timer.h"
+#include "testutil.h"
+
+using namespace miniduo;
+
+typedef std::chrono::steady_clock Clock;
+
+void testRandomTimers() {
+    const int64_t kTickUs = 1000;
+    const Timestamp kStart = 1000000;
+    const int kTimers = 20000;
+    const uint64_t kMaxDelayTicks = 300000; // 跨越第 0-2 层
+    TimerWheel wheel(kTickUs, kStart);
+    std::mt19937 rng(7);
+    std::vector<std::unique_ptr<WheelTimer>> timers;
+    std::vector<int64_t> expected(kTimers, -1); // 期望运行的 tick, -1 表示不应运行
+    std::vector<int64_t> fired(kTimers, -1);
+    int64_t now = 0;
+    for(int i=0; i<kTimers; i++) {
+        timers.emplace_back(new WheelTimer([i, &fired, &now] { fired[i] = now; }));
+    }
+    uint64_t lastTick = 0;
+    for(int64_t tick=0; tick <= static_cast<int64_t>(kMaxDelayTicks * 2); tick++) {
+        now = tick;
+        // 前半段随机加入、刷新、取消
+        if(tick < static_cast<int64_t>(kMaxDelayTicks)) {
+            for(int k=0; k<2; k++) {
+                int i = rng() % kTimers;
+                if(rng() % 4 == 0) {
+                    timers[i]->cancel();
+                    expected[i] = -1;
+                    fired[i] = -1;
+                }
+                else {
+                    uint64_t delay = rng() % kMaxDelayTicks;
+                    wheel.add(timers[i].get(), delay * kTickUs / 1e6);
+                    expected[i] = tick + delay;
+                    fired[i] = -1;
+                }
+            }
+        }
+        wheel.advance(kStart + tick * kTickUs);
+        lastTick = tick;
+    }
+    check(wheel.empty(), "all timers expired");
+    int mismatches = 0;
+    for(int i=0; i<kTimers; i++) {
+        if(fired[i] != expected[i]) {
+            mismatches++;
+        }
+    }
+    check(mismatches == 0, "timers fire exactly at their expiration tick");
+    printf("random timers: %d timers over %lu ticks, %d mismatches\n",
+           kTimers, static_cast<unsigned long>(lastTick), mismatches);
+}
+
+// 与 TimerQueue 相同，只在 nextEventTime() 唤醒并推进
+void testSparseAdvance() {
+    const int64_t kTickUs = 1000;
+    const Timestamp kStart = 1000000;
+    const int kTimers = 2000;
+    const uint64_t kMaxDelayTicks = 3000000; // 跨越全部 4 层
+    TimerWheel wheel(kTickUs, kStart);
+    std::mt19937 rng(11);
+    std::vector<std::unique_ptr<WheelTimer>> timers;
+    std::vector<int64_t> expected(kTimers);
+    std::vector<int64_t> fired(kTimers, -1);
+    int64_t now = 0;
+    for(int i=0; i<kTimers; i++) {
+        timers.emplace_back(new WheelTimer([i, &fired, &now] { fired[i] = now; }));
+        uint64_t delay = rng() % kMaxDelayTicks;
+        wheel.add(timers[i].get(), delay * kTickUs / 1e6);
+        expected[i] = delay;
+    }
+    int wakeups = 0;
+    while(!wheel.empty() && wakeups < 10 * kTimers) {
+        Timestamp t = wheel.nextEventTime();
+        now = (t - kStart) / kTickUs;
+        wheel.advance(t);
+        wakeups++;
+    }
+    check(wheel.empty(), "all timers expired with sparse wakeups");
+    int mismatches = 0;
+    for(int i=0; i<kTimers; i++) {
+        if(fired[i] != expected[i]) {
+            mismatches++;
+        }
+    }
+    check(mismatches == 0, "timers fire exactly at their expiration tick with sparse wakeups");
+    // 每个定时器最多经过 3 次分配，加上到期
+    check(wakeups <= 4 * kTimers, "wakeups bounded by timers and cascades");
+    printf("sparse advance: %d timers over %lu ticks, %d wakeups, %d mismatches\n",
+           kTimers, static_cast<unsigned long>(kMaxDelayTicks), wakeups, mismatches);
+}
+
+void testReAddInCallback() {
+    TimerWheel wheel(1000, 0);
+    int runs = 0;
+    WheelTimer timer;
+    timer.setCallback([&] {
+        if(++runs < 5) {
+            wheel.add(&timer, 0.01);
+        }
+    });
+    wheel.add(&timer, 0.01);
+    for(int64_t t=0; t<=100 * 1000; t += 1000) {
+        wheel.advance(t);
+    }
+    check(runs == 5, "timer re-added in its callback");
+    {
+        WheelTimer scoped;
+        wheel.add(&scoped, 1);
+        check(wheel.size() == 1, "size after add");
+    }
+    check(wheel.empty(), "timer removed on destruction");
+}
+
+// 时间轮中已有远期定时器、一段时间没有推进时加入的定时器不应提前运行
+void testAddToIdleWheel() {
+    TimerWheel wheel(1000, 0);
+    WheelTimer pending;
+    wheel.add(&pending, 60);
+    wheel.advance(0);
+    Timestamp fired = -1;
+    Timestamp now = 3 * 1000 * 1000;
+    WheelTimer timer([&] { fired = now; });
+    wheel.add(&timer, 2, now);
+    for(; now <= 6 * 1000 * 1000 && fired < 0; now += 1000) {
+        wheel.advance(now);
+    }
+    check(fired >= 5 * 1000 * 1000 && fired <= 5 * 1000 * 1000 + 2000,
+          "timer added to an idle wheel fires after its delay");
+
+    // 通过 EventLoop: 60 秒的定时器等待中，1 秒后加入 0.3 秒的定时器
+    EventLoop loop;
+    WheelTimer longTimer;
+    WheelTimer shortTimer;
+    Timestamp added = 0;
+    double elapsed = -1;
+    shortTimer.setCallback([&] {
+        elapsed = (util::getMonotonicNow() - added) / 1e6;
+        loop.quit();
+    });
+    loop.runAfter(0, [&] { loop.addWheelTimer(&longTimer, 60); });
+    loop.runAfter(1, [&] {
+        added = util::getMonotonicNow();
+        loop.addWheelTimer(&shortTimer, 0.3);
+    });
+    loop.runAfter(3, [&] { loop.quit(); });
+    loop.loop();
+    check(elapsed >= 0.3 - 0.01, "loop wheel timer added with another pending does not fire early");
+    printf("idle wheel: added at 3.0 s fired at %.3f s, loop timer fired %.3f s after add\n",
+           fired / 1e6, elapsed);
+}
+
+// 10 万个连接的超时各刷新 10 次 (相当于每条消息刷新一次)
+void benchRefresh() {
+    const int kConns = 100000;
+    const int kRounds = 10;
+    EventLoop loop;
+    loop.runAfter(0, [&] {
+        std::vector<TimerId> ids(kConns);
+        auto start = Clock::now();
+        for(int r=0; r<kRounds; r++) {
+            for(int i=0; i<kConns; i++) {
+                if(r > 0) {
+                    loop.cancel(ids[i]);
+                }
+                ids[i] = loop.runAfter(30, [] {});
+            }
+        }
+        double setMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        for(auto& id: ids) {
+            loop.cancel(id);
+        }
+
+        std::vector<WheelTimer> timers(kConns);
+        start = Clock::now();
+        for(int r=0; r<kRounds; r++) {
+            for(int i=0; i<kConns; i++) {
+                loop.addWheelTimer(&timers[i], 30);
+            }
+        }
+        double wheelMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        for(auto& timer: timers) {
+            timer.cancel();
+        }
+        printf("refresh %d timers x %d: runAfter + cancel %7.1f ms  addWheelTimer %7.1f ms\n",
+               kConns, kRounds, setMs, wheelMs);
+        loop.quit();
+    });
+    loop.loop();
+}
+
+int main() {
+    testRandomTimers();
+    testSparseAdvance();
+    testReAddInCallback();
+    testAddToIdleWheel();
+    benchRefresh();
+    printf("%s\n", g_ok ? "all passed" : "FAILED");
+    return g_ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+// 测试程序共用: 检查结果、连接本机端口、每种模式在独立的子进程中运行
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static bool g_ok = true;
+
+/// @brief cond 不成立时输出 what 并记为失败 (g_ok)
+inline void check(bool cond, const char* what) {
+    if(!cond) {
+        printf("FAILED: %s\n", what);
+        g_ok = false;
+    }
+}
+
+/// @brief 阻塞连接到 127.0.0.1:port，失败返回 -1
+/// rcvbuf > 0 时在连接前设置接收缓冲区大小
+inline int tryConnect(int port, int rcvbuf = 0) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(rcvbuf > 0) {
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// @brief 同上，失败时结束 (子) 进程
+inline int connectTo(int port, int rcvbuf = 0) {
+    int fd = tryConnect(port, rcvbuf);
+    if(fd < 0) {
+        perror("connect");
+        _exit(1);
+    }
+    return fd;
+}
+
+/// @brief 同 connectTo()，并关闭 Nagle 算法，用于测量往返延迟
+inline int connectNoDelay(int port) {
+    int fd = connectTo(port);
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return fd;
+}
+
+/// @brief 按 g_ok 直接结束子进程，不析构仍在运行的 loop 线程与 server
+inline void exitChild() {
+    fflush(stdout);
+    _exit(g_ok ? 0 : 1);
+}
+
+/// @brief fork 一个子进程运行 run()，run 以 exitChild() 或 _exit() 结束子进程
+/// (返回时同样按 g_ok 结束)
+/// @return 子进程是否以 0 退出
+template <class Run>
+bool runChild(Run run) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0) {
+        run();
+        exitChild();
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/// @brief 每种模式在一个子进程中运行 run(mode, port)，端口从 basePort 起依次加一
+/// @return 失败的模式数
+template <class Mode, size_t N, class Run>
+int runModes(const Mode (&modes)[N], int basePort, Run run) {
+    int failed = 0;
+    for(size_t i=0; i<N; i++) {
+        const int port = basePort + static_cast<int>(i);
+        if(!runChild([&] { run(modes[i], port); })) {
+            failed++;
+        }
+    }
+    return failed;
+}
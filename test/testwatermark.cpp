@@ -0,0 +1,120 @@
+// TcpConnection 高/低水位: 回显服务器的对端只写不读，输出超过高水位后服务器暂停读取，
+// 待发送的字节数不再增长；对端开始读取后降到低水位，恢复读取并收到全部回显
+// level-triggered、edge-triggered 与 completion 模式各在独立的子进程中运行
+#include "miniduo/conn.h"
+#include "miniduo/EventLoop.h"
+#include "miniduo/net.h"
+#include "testutil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace miniduo;
+
+const size_t kHighWaterMark = 256 * 1024;
+const size_t kLowWaterMark = 64 * 1024;
+const size_t kTotal = 16 * 1024 * 1024;
+const int kBasePort = 19710;
+
+void runMode(const char* name, bool edgeTriggered, bool completionMode, int port) {
+    std::atomic<int> highCount(0);
+    std::atomic<int> lowCount(0);
+    std::atomic<int64_t> maxPending(0);
+    std::atomic<EventLoop*> serverLoop(nullptr);
+    std::thread loopThread([&] {
+        EventLoop loop;
+        TcpServer server(&loop, SockAddr(port));
+        server.setCompletionMode(completionMode);
+        server.setEdgeTriggered(edgeTriggered);
+        server.setPauseReadOnHighWater(true);
+        server.setHighWaterMarkCallback([&](const TcpConnectionPtr&, size_t) { highCount++; },
+                                        kHighWaterMark);
+        server.setLowWaterMarkCallback([&](const TcpConnectionPtr&) { lowCount++; },
+                                       kLowWaterMark);
+        server.setConnectionCallback([](const TcpConnectionPtr&) {});
+        server.setMsgCallback([&](const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+            conn->send(buf->retrieveAsString());
+            int64_t pending = conn->getLoop()->pendingBytes();
+            if(pending > maxPending) {
+                maxPending = pending;
+            }
+        });
+        server.start();
+        serverLoop = &loop;
+        loop.loop();
+    });
+    while(serverLoop == nullptr) {
+        usleep(1000);
+    }
+    usleep(100 * 1000);
+
+    int fd = connectTo(port);
+    ::fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    // 只写不读，直到服务器停止读取后双方的 socket 缓冲区都写满
+    std::string chunk(64 * 1024, 'w');
+    size_t sent = 0;
+    while(sent < kTotal) {
+        pollfd pfd = { fd, POLLOUT, 0 };
+        if(::poll(&pfd, 1, 300) == 0) {
+            break;
+        }
+        ssize_t n = ::write(fd, chunk.data(), std::min(chunk.size(), kTotal - sent));
+        if(n > 0) {
+            sent += n;
+        }
+    }
+    check(sent < kTotal, "server stops reading above high water mark");
+    check(highCount == 1, "high water mark callback");
+    check(maxPending < static_cast<int64_t>(kHighWaterMark + 1024 * 1024), "pending bytes bounded");
+
+    // 开始读取，服务器降到低水位后恢复读取
+    size_t received = 0;
+    char buf[65536];
+    while(received < kTotal) {
+        pollfd pfd = { fd, static_cast<short>(sent < kTotal ? POLLIN | POLLOUT : POLLIN), 0 };
+        if(::poll(&pfd, 1, 2000) <= 0) {
+            break;
+        }
+        if(pfd.revents & POLLIN) {
+            ssize_t n = ::read(fd, buf, sizeof buf);
+            if(n <= 0) {
+                break;
+            }
+            received += n;
+        }
+        if((pfd.revents & POLLOUT) && sent < kTotal) {
+            ssize_t n = ::write(fd, chunk.data(), std::min(chunk.size(), kTotal - sent));
+            if(n > 0) {
+                sent += n;
+            }
+        }
+    }
+    check(received == kTotal, "all data echoed after resuming");
+    check(lowCount >= 1 && lowCount == highCount, "low water mark callback");
+    printf("%-16s high %d low %d  max pending %lld KiB  %s\n", name, highCount.load(),
+           lowCount.load(), static_cast<long long>(maxPending / 1024), g_ok ? "OK" : "FAILED");
+    exitChild();
+}
+
+int main() {
+    struct {
+        const char* name;
+        bool edgeTriggered;
+        bool completionMode;
+    } modes[] = {
+        {"level-triggered", false, false},
+        {"edge-triggered", true, false},
+        {"completion", false, true},
+    };
+    int failed = runModes(modes, kBasePort, [](const auto& m, int port) {
+        runMode(m.name, m.edgeTriggered, m.completionMode, port);
+    });
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+// 把 LogFormat::BINARY 写出的日志解码为文本
+// 用法: logdecode [file...]   没有参数时读 stdin, 结果写到 stdout
+#include <stdio.h>
+
+#include "miniduo/logrecord.h"
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        if(!decodeBinaryLog(stdin, stdout)) {
+            fprintf(stderr, "logdecode: stdin: not a binary log or truncated\n");
+            return 1;
+        }
+        return 0;
+    }
+    int ret = 0;
+    for(int i=1; i<argc; i++) {
+        FILE* fp = fopen(argv[i], "rb");
+        if(fp == nullptr) {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        if(!decodeBinaryLog(fp, stdout)) {
+            fprintf(stderr, "logdecode: %s: not a binary log or truncated\n", argv[i]);
+            ret = 1;
+        }
+        fclose(fp);
+    }
+    return ret;
+}